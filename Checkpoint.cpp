@@ -0,0 +1,165 @@
+#include "include/Checkpoint.hpp"
+#include "include/FluidSimulation.hpp"
+#include "include/ParticleData.hpp"
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char CHECKPOINT_MAGIC[8]={'S', 'P', 'H', 'C', 'K', 'P', 'T', '\0'};
+static const uint32_t CHECKPOINT_BYTE_ORDER=0x01020304;
+
+static_assert(sizeof(CheckpointHeader)<=CHECKPOINT_ALIGNMENT, "header must fit before the first section");
+static_assert(CHECKPOINT_ALIGNMENT%ParticleData::FIELD_ALIGNMENT==0, "mapped fields must stay aligned");
+
+static uint64_t alignUp(uint64_t bytes) {
+	return (bytes+CHECKPOINT_ALIGNMENT-1)/CHECKPOINT_ALIGNMENT*CHECKPOINT_ALIGNMENT;
+}
+
+static bool fail(std::string* error, const std::string& message) {
+	if (error) *error=message;
+	return false;
+}
+
+static bool inRange(int32_t value, int first, int last) {
+	return value>=first && value<=last;
+}
+
+// Enums name a value this build knows, every float is finite, and the
+// lengths and timesteps the simulation divides by are positive.
+static bool validParameters(const CheckpointParameters& p) {
+	const float floats[]={
+		p.targetDensity, p.pressureMultiplier, p.taitExponent, p.gravity, p.collisionDamping,
+		p.mouseRadius, p.viscosityStrength, p.particleSize, p.particleSpacing, p.smoothingRadius,
+		p.boundsWidth, p.boundsHeight, p.gridMigrationThreshold, p.verletSkin, p.courantNumber,
+		p.referenceTimestep, p.minTimestep
+	};
+	for (float value : floats)
+		if (!std::isfinite(value)) return false;
+	return inRange(p.equationOfState, (int)EquationOfState::Linear, (int)EquationOfState::Tait) &&
+		inRange(p.initialLayout, (int)InitialLayout::Square, (int)InitialLayout::Random) &&
+		inRange(p.sortMode, (int)SpatialSortMode::Std, (int)SpatialSortMode::Radix) &&
+		inRange(p.gridMode, (int)SpatialGridMode::Hashed, (int)SpatialGridMode::Dense) &&
+		inRange(p.reorderOrder, (int)ParticleOrder::CellKey, (int)ParticleOrder::ZOrder) &&
+		p.smoothingRadius>0 && p.boundsWidth>0 && p.boundsHeight>0 &&
+		p.particleSize>=0 && p.verletSkin>=0 && p.reorderInterval>=0 &&
+		p.courantNumber>0 && p.referenceTimestep>0 && p.minTimestep>0;
+}
+
+static bool writePadded(FILE* file, const void* data, size_t bytes) {
+	static const char zeros[CHECKPOINT_ALIGNMENT]={};
+	if (bytes>0 && fwrite(data, 1, bytes, file)!=bytes) return false;
+	size_t padding=alignUp(bytes)-bytes;
+	return padding==0 || fwrite(zeros, 1, padding, file)==padding;
+}
+
+bool WriteCheckpoint(const char* path, CheckpointHeader header, const float* particleBlock,
+		const float* accelerations, std::string* error) {
+	uint64_t particleBytes=header.stride*ParticleData::NUM_FIELDS*sizeof(float);
+	uint64_t accelerationBytes=header.count*sizeof(float);
+	std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version=CHECKPOINT_VERSION;
+	header.headerBytes=sizeof(CheckpointHeader);
+	header.byteOrder=CHECKPOINT_BYTE_ORDER;
+	header.numFields=ParticleData::NUM_FIELDS;
+	header.particleOffset=CHECKPOINT_ALIGNMENT;
+	header.accelerationOffset=header.particleOffset+alignUp(particleBytes);
+	header.fileBytes=header.accelerationOffset+alignUp(accelerationBytes);
+
+	std::string temporaryPath=std::string(path)+".tmp";
+	FILE* file=fopen(temporaryPath.c_str(), "wb");
+	if (!file) return fail(error, "cannot create "+temporaryPath);
+	bool written=writePadded(file, &header, sizeof(header)) &&
+		writePadded(file, particleBlock, particleBytes) &&
+		writePadded(file, accelerations, accelerationBytes);
+	written=fclose(file)==0 && written;
+	if (!written || rename(temporaryPath.c_str(), path)!=0) {
+		remove(temporaryPath.c_str());
+		return fail(error, std::string("cannot write ")+path);
+	}
+	return true;
+}
+
+MappedCheckpoint::MappedCheckpoint() : base(nullptr), bytes(0) {}
+
+MappedCheckpoint::~MappedCheckpoint() {
+	if (base) munmap(base, bytes);
+}
+
+bool MappedCheckpoint::Open(const char* path, std::string* error) {
+	if (base) munmap(base, bytes);
+	base=nullptr;
+	bytes=0;
+	int fd=open(path, O_RDONLY);
+	if (fd<0) return fail(error, std::string("cannot open ")+path);
+	struct stat info;
+	if (fstat(fd, &info)!=0 || (size_t)info.st_size<sizeof(CheckpointHeader)) {
+		close(fd);
+		return fail(error, std::string(path)+" is not a checkpoint");
+	}
+	// Private and writable: the simulation writes into the adopted arrays,
+	// and those pages are copied on first write instead of reaching the file.
+	void* mapped=mmap(nullptr, info.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped==MAP_FAILED) return fail(error, std::string("cannot map ")+path);
+	base=mapped;
+	bytes=info.st_size;
+
+	const CheckpointHeader& header=Header();
+	std::string problem;
+	if (std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic))!=0)
+		problem="is not a checkpoint";
+	else if (header.version!=CHECKPOINT_VERSION)
+		problem="has version "+std::to_string(header.version)+", expected "+std::to_string(CHECKPOINT_VERSION);
+	else if (header.byteOrder!=CHECKPOINT_BYTE_ORDER)
+		problem="was written with a different byte order";
+	else if (header.headerBytes!=sizeof(CheckpointHeader) || header.numFields!=ParticleData::NUM_FIELDS)
+		problem="has a different particle layout";
+	else if (header.stride<header.count || header.stride%(ParticleData::FIELD_ALIGNMENT/sizeof(float))!=0 ||
+		header.count>INT_MAX)
+		problem="has an invalid particle count";
+	// Each section is checked as an offset and a length that both fit in the
+	// file, with the stride bounded before it is multiplied, so no sum or
+	// product can wrap.
+	else if (header.fileBytes!=bytes || header.particleOffset%CHECKPOINT_ALIGNMENT!=0 ||
+		header.accelerationOffset%CHECKPOINT_ALIGNMENT!=0 ||
+		header.stride>bytes/(ParticleData::NUM_FIELDS*sizeof(float)) ||
+		header.particleOffset>bytes ||
+		header.stride*ParticleData::NUM_FIELDS*sizeof(float)>bytes-header.particleOffset ||
+		header.accelerationOffset>bytes ||
+		header.count*sizeof(float)>bytes-header.accelerationOffset)
+		problem="is truncated";
+	else if (!validParameters(header.parameters))
+		problem="has invalid parameters";
+	if (!problem.empty()) {
+		munmap(base, bytes);
+		base=nullptr;
+		bytes=0;
+		return fail(error, std::string(path)+" "+problem);
+	}
+	return true;
+}
+
+const CheckpointHeader& MappedCheckpoint::Header() const {
+	return *(const CheckpointHeader*)base;
+}
+
+float* MappedCheckpoint::Particles() const {
+	return (float*)((char*)base+Header().particleOffset);
+}
+
+float* MappedCheckpoint::Accelerations() const {
+	return (float*)((char*)base+Header().accelerationOffset);
+}
+
+std::function<void()> MappedCheckpoint::Release() {
+	void* mapped=base;
+	size_t mappedBytes=bytes;
+	base=nullptr;
+	bytes=0;
+	return [mapped, mappedBytes]() { munmap(mapped, mappedBytes); };
+}
@@ -1,97 +1,564 @@
 #include "include/FluidSimulation.hpp"
 #include "include/raymath.h"
+#include <cstring>
+#include <random>
 
-void FluidSimulation::initParticlesRandomly() {
+static unsigned long long mix64(unsigned long long z) {
+	z+=0x9e3779b97f4a7c15ull;
+	z=(z^(z>>30))*0xbf58476d1ce4e5b9ull;
+	z=(z^(z>>27))*0x94d049bb133111ebull;
+	return z^(z>>31);
+}
+
+// Counter-based random numbers: a hash of the seed and three counters, so any
+// thread can draw the number for any particle without shared generator state.
+static unsigned int counterRandom(unsigned int seed, unsigned int a, unsigned int b, unsigned int c) {
+	return (unsigned int)mix64(mix64(((unsigned long long)seed<<32)|a)^(((unsigned long long)b<<32)|c));
+}
+
+// Stands in for raylib's GetRandomValue, which the simulation must not call so
+// it can run headless.
+static int randomValue(unsigned int bits, int min, int max) {
+	return min+(int)(bits%(unsigned int)(max-min+1));
+}
+
+template <typename Kernels>
+unsigned int BasicFluidSimulation<Kernels>::randomBits(unsigned int a, unsigned int b) const {
+	return counterRandom(runSeed, (unsigned int)stepCount, a, b);
+}
+
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::initParticlesRandomly() {
 	Vector2 halfBoundsSize=Vector2SubtractValue(
 		Vector2Scale(boundsSize, 0.5),
 		particleSize);
 
 	for (int i=0; i<numParticles; i++) {
-		positions[i] = (Vector2){
-			(float)GetRandomValue(-halfBoundsSize.x, halfBoundsSize.x),
-			(float)GetRandomValue(-halfBoundsSize.y, halfBoundsSize.y)};
-		velocities[i] = (Vector2){0, 0};
+		particles.SetPosition(i, (Vector2){
+			(float)randomValue(randomBits(i, 0), -halfBoundsSize.x, halfBoundsSize.x),
+			(float)randomValue(randomBits(i, 1), -halfBoundsSize.y, halfBoundsSize.y)});
+		particles.SetVelocity(i, (Vector2){0, 0});
 	}
 }
 
-void FluidSimulation::initParticlesInSquare() {
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::initParticlesInSquare() {
 	int particlesPerRow=(int)sqrt(numParticles);
 	int particlesPerCol=(numParticles - 1) / particlesPerRow + 1;
 	float spacing = particleSize * 2 + particleSpacing;
 
 	for (int i=0; i<numParticles; i++) {
-		positions[i]=(Vector2){
+		particles.SetPosition(i, (Vector2){
 			(i%particlesPerRow-particlesPerRow/2.f+0.5f)*spacing,
 			(i/particlesPerRow-particlesPerCol/2.f+0.5f)*spacing
-		};
-		velocities[i]=(Vector2){0, 0};
+		});
+		particles.SetVelocity(i, (Vector2){0, 0});
 	}
 }
 
-void FluidSimulation::Start() {
-	positions.clear(); positions.resize(numParticles);
-	velocities.clear(); velocities.resize(numParticles);
-	densities.clear(); densities.resize(numParticles);
-	predictedPositions.clear(); predictedPositions.resize(numParticles);
+// A column twice as tall as it is wide, resting in the bottom-left corner.
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::initParticlesDamBreak() {
+	int particlesPerRow=std::max(1, (int)sqrt(numParticles/2.f));
+	float spacing = particleSize * 2 + particleSpacing;
+	Vector2 corner=(Vector2){
+		-boundsSize.x/2+particleSize+spacing/2,
+		-boundsSize.y/2+particleSize+spacing/2
+	};
+
+	for (int i=0; i<numParticles; i++) {
+		particles.SetPosition(i, (Vector2){
+			corner.x+(i%particlesPerRow)*spacing,
+			corner.y+(i/particlesPerRow)*spacing
+		});
+		particles.SetVelocity(i, (Vector2){0, 0});
+	}
+}
+
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::resetWorkspace() {
+	reorderKeys.resize(numParticles);
+	permutation.resize(numParticles);
+	particleSlots.resize(numParticles);
+	viscosityX.assign(numParticles, 0.f);
+	viscosityY.assign(numParticles, 0.f);
+	sqrAccelerations.assign(numParticles, 0.f);
+	timestepStats=(TimestepStats){0, 0, 0, 0, 0};
+	stepScale=1.f;
+	pairwiseActive=false;
+	verletValid=false;
+	verletStats=(VerletStats){0, 0, 0, false};
 	spatialLookup.Resize(numParticles);
+	spatialLookup.SetSortMode(deterministic?SpatialSortMode::Radix:sortMode);
+	spatialLookup.SetGridMode(gridMode);
+	spatialLookup.SetBounds(Vector2Scale(boundsSize, -0.5f), boundsSize);
+}
+
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::Start() {
+	particles.Resize(numParticles);
+	resetWorkspace();
+	for (int i=0; i<numParticles; i++) {
+		particles.id[i]=i;
+		particleSlots[i]=i;
+	}
+	stepCount=0;
+	runSeed=deterministic?seed:std::random_device{}();
 	mass=1.f;
-	initParticlesInSquare();
-	// initParticlesRandomly();
-	spatialLookup.UpdateSpatialLookup(positions, smoothingRadius);
+	switch (initialLayout) {
+		case InitialLayout::Square: initParticlesInSquare(); break;
+		case InitialLayout::DamBreak: initParticlesDamBreak(); break;
+		case InitialLayout::Random: initParticlesRandomly(); break;
+	}
+	std::copy(particles.x, particles.x+numParticles, particles.previousX);
+	std::copy(particles.y, particles.y+numParticles, particles.previousY);
+	spatialLookup.UpdateSpatialLookup(particles.x, particles.y, smoothingRadius);
+}
+
+template <typename Kernels>
+CheckpointParameters BasicFluidSimulation<Kernels>::getParameters() const {
+	CheckpointParameters parameters;
+	std::memset(&parameters, 0, sizeof(parameters));
+	parameters.targetDensity=targetDensity;
+	parameters.pressureMultiplier=pressureMultiplier;
+	parameters.equationOfState=(int32_t)equationOfState;
+	parameters.taitExponent=taitExponent;
+	parameters.gravity=gravity;
+	parameters.forceType=forceType;
+	parameters.collisionDamping=collisionDamping;
+	parameters.mouseRadius=mouseRadius;
+	parameters.viscosityStrength=viscosityStrength;
+	parameters.particleSize=particleSize;
+	parameters.particleSpacing=particleSpacing;
+	parameters.smoothingRadius=smoothingRadius;
+	parameters.boundsWidth=boundsSize.x;
+	parameters.boundsHeight=boundsSize.y;
+	parameters.initialLayout=(int32_t)initialLayout;
+	parameters.sortMode=(int32_t)sortMode;
+	parameters.gridMode=(int32_t)gridMode;
+	parameters.incrementalGrid=incrementalGrid;
+	parameters.gridMigrationThreshold=gridMigrationThreshold;
+	parameters.useNeighbourCache=useNeighbourCache;
+	parameters.reorderInterval=reorderInterval;
+	parameters.reorderOrder=(int32_t)reorderOrder;
+	parameters.useSimd=useSimd;
+	parameters.deterministic=deterministic;
+	parameters.seed=seed;
+	parameters.adaptiveTimestep=adaptiveTimestep;
+	parameters.pairwiseForces=pairwiseForces;
+	parameters.verletSkin=verletSkin;
+	parameters.courantNumber=courantNumber;
+	parameters.referenceTimestep=referenceTimestep;
+	parameters.minTimestep=minTimestep;
+	return parameters;
+}
+
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::setParameters(const CheckpointParameters& parameters) {
+	targetDensity=parameters.targetDensity;
+	pressureMultiplier=parameters.pressureMultiplier;
+	equationOfState=(EquationOfState)parameters.equationOfState;
+	taitExponent=parameters.taitExponent;
+	gravity=parameters.gravity;
+	forceType=parameters.forceType;
+	collisionDamping=parameters.collisionDamping;
+	mouseRadius=parameters.mouseRadius;
+	viscosityStrength=parameters.viscosityStrength;
+	particleSize=parameters.particleSize;
+	particleSpacing=parameters.particleSpacing;
+	smoothingRadius=parameters.smoothingRadius;
+	boundsSize=(Vector2){parameters.boundsWidth, parameters.boundsHeight};
+	initialLayout=(InitialLayout)parameters.initialLayout;
+	sortMode=(SpatialSortMode)parameters.sortMode;
+	gridMode=(SpatialGridMode)parameters.gridMode;
+	incrementalGrid=parameters.incrementalGrid!=0;
+	gridMigrationThreshold=parameters.gridMigrationThreshold;
+	useNeighbourCache=parameters.useNeighbourCache!=0;
+	reorderInterval=parameters.reorderInterval;
+	reorderOrder=(ParticleOrder)parameters.reorderOrder;
+	useSimd=parameters.useSimd!=0;
+	deterministic=parameters.deterministic!=0;
+	seed=parameters.seed;
+	adaptiveTimestep=parameters.adaptiveTimestep!=0;
+	pairwiseForces=parameters.pairwiseForces!=0;
+	verletSkin=parameters.verletSkin;
+	courantNumber=parameters.courantNumber;
+	referenceTimestep=parameters.referenceTimestep;
+	minTimestep=parameters.minTimestep;
+}
+
+template <typename Kernels>
+bool BasicFluidSimulation<Kernels>::SaveCheckpoint(const char* path, std::string* error) const {
+	CheckpointHeader header;
+	std::memset(&header, 0, sizeof(header));
+	header.count=numParticles;
+	header.stride=particles.Stride();
+	std::strncpy(header.kernels, Kernels::name, sizeof(header.kernels)-1);
+	header.stepCount=stepCount;
+	header.runSeed=runSeed;
+	header.mass=mass;
+	header.stepScale=stepScale;
+	header.parameters=getParameters();
+	return WriteCheckpoint(path, header, particles.Field(0), sqrAccelerations.data(), error);
+}
+
+// Everything a step reads from earlier steps is restored: the particle
+// arrays, the step counter and seed behind the random numbers, and the
+// accelerations the adaptive timestep starts from. The grid is rebuilt from
+// the predicted positions, as the last step left it, so reordering by cell
+// key resumes identically. Cached Verlet lists are rebuilt on the first step,
+// which can change their neighbour order and with it the rounding.
+template <typename Kernels>
+bool BasicFluidSimulation<Kernels>::LoadCheckpoint(const char* path, std::string* error) {
+	MappedCheckpoint checkpoint;
+	if (!checkpoint.Open(path, error)) return false;
+	const CheckpointHeader& header=checkpoint.Header();
+	if (std::strncmp(header.kernels, Kernels::name, sizeof(header.kernels))!=0) {
+		if (error) *error=std::string(path)+" was written with the "+
+			std::string(header.kernels, strnlen(header.kernels, sizeof(header.kernels)))+" kernels";
+		return false;
+	}
+	// IDs index particleSlots, so they must be a permutation of the slots.
+	unsigned int count=header.count;
+	const int* ids=(const int*)(checkpoint.Particles()+ParticleData::ID*header.stride);
+	std::vector<int> slots(count, -1);
+	for (unsigned int i=0; i<count; i++) {
+		if (ids[i]<0 || (unsigned int)ids[i]>=count || slots[ids[i]]>=0) {
+			if (error) *error=std::string(path)+" has invalid particle IDs";
+			return false;
+		}
+		slots[ids[i]]=i;
+	}
+
+	setParameters(header.parameters);
+	numParticles=count;
+	resetWorkspace();
+	particleSlots.swap(slots);
+	std::copy(checkpoint.Accelerations(), checkpoint.Accelerations()+count, sqrAccelerations.begin());
+	stepCount=header.stepCount;
+	runSeed=header.runSeed;
+	mass=header.mass;
+	stepScale=header.stepScale;
+	float* block=checkpoint.Particles();
+	size_t stride=header.stride;
+	particles.Adopt(block, count, stride, checkpoint.Release());
+	float radius=useNeighbourCache && verletSkin>0?smoothingRadius+verletSkin:smoothingRadius;
+	spatialLookup.UpdateSpatialLookup(particles.predictedX, particles.predictedY, radius);
+	return true;
+}
+
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::SetParticleState(const float* x, const float* y, const float* vx, const float* vy,
+		unsigned int count, bool keepPrevious) {
+	if (count!=particles.Size()) {
+		numParticles=count;
+		particles.Resize(count);
+		resetWorkspace();
+		for (int i=0; i<numParticles; i++) {
+			particles.id[i]=i;
+			particleSlots[i]=i;
+		}
+		keepPrevious=false;
+	}
+	PARALLEL_FOR_BEGIN(numParticles) {
+		int id=particles.id[i];
+		particles.previousX[i]=keepPrevious?particles.x[i]:x[id];
+		particles.previousY[i]=keepPrevious?particles.y[i]:y[id];
+		particles.x[i]=x[id];
+		particles.y[i]=y[id];
+		particles.predictedX[i]=x[id];
+		particles.predictedY[i]=y[id];
+		particles.vx[i]=vx[id];
+		particles.vy[i]=vy[id];
+	}PARALLEL_FOR_END();
 }
 
-float FluidSimulation::densityToPressure(float density) {
+template <typename Kernels>
+float BasicFluidSimulation<Kernels>::densityToPressure(float density) {
+	// Tait needs a rest density to scale against; without one the linear law
+	// is the only meaningful choice.
+	if (equationOfState==EquationOfState::Tait && targetDensity>0) {
+		// B is chosen so the slope at rest density matches the linear law.
+		float stiffness=pressureMultiplier*targetDensity/taitExponent;
+		return stiffness*(powf(density/targetDensity, taitExponent)-1);
+	}
 	float densityError = density - targetDensity;
 	return densityError * pressureMultiplier;
 }
 
-void FluidSimulation::resolveCollisions(Vector2& position, Vector2& velocity) {
-	Vector2 halfBoundsSize=Vector2SubtractValue(
-		Vector2Scale(boundsSize, 0.5),
-		particleSize);
-	if (abs(position.x)>halfBoundsSize.x) {
-		position.x=halfBoundsSize.x*(2*(position.x>=0)-1);
-		velocity.x *= -1 * collisionDamping;
+// Stores a particle's density along with what the force passes derive from
+// it, so they never evaluate the equation of state or divide per pair.
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::setDensity(int particleIdx, float density) {
+	particles.density[particleIdx]=density;
+	particles.pressure[particleIdx]=densityToPressure(density);
+	particles.invDensity[particleIdx]=1.f/density;
+}
+
+// The per-particle streaming passes take every field as a restrict-qualified
+// parameter so the compiler can vectorize them without alias checks.
+static void predictRange(int start, int end, float gravityStep, float lookahead,
+		const float* __restrict x, const float* __restrict y,
+		const float* __restrict vx, float* __restrict vy,
+		float* __restrict predictedX, float* __restrict predictedY,
+		float* __restrict previousX, float* __restrict previousY) {
+	for (int i=start; i<end; i++) {
+		previousX[i]=x[i];
+		previousY[i]=y[i];
+		vy[i]-=gravityStep;
+		predictedX[i]=x[i]+vx[i]*lookahead;
+		predictedY[i]=y[i]+vy[i]*lookahead;
+	}
+}
+
+static void integrateRange(int start, int end, float stepScale, float halfBoundsX, float halfBoundsY, float bounce,
+		float* __restrict x, float* __restrict y,
+		float* __restrict vx, float* __restrict vy,
+		const float* __restrict dvx, const float* __restrict dvy) {
+	for (int i=start; i<end; i++) {
+		vx[i]+=dvx[i];
+		vy[i]+=dvy[i];
+		float px=x[i]+vx[i]*stepScale;
+		float py=y[i]+vy[i]*stepScale;
+		float clampedX=std::min(std::max(px, -halfBoundsX), halfBoundsX);
+		float clampedY=std::min(std::max(py, -halfBoundsY), halfBoundsY);
+		vx[i]*=clampedX!=px?bounce:1.f;
+		vy[i]*=clampedY!=py?bounce:1.f;
+		x[i]=clampedX;
+		y[i]=clampedY;
 	}
-	if (abs(position.y)>halfBoundsSize.y) {
-		position.y=halfBoundsSize.y*(2*(position.y>=0)-1);
-		velocity.y *= -1 * collisionDamping;
+}
+
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::predictPositions(int start, int end, float deltaTime) {
+	predictRange(start, end, gravity*deltaTime, 0.5f*stepScale,
+		particles.x, particles.y, particles.vx, particles.vy,
+		particles.predictedX, particles.predictedY,
+		particles.previousX, particles.previousY);
+}
+
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::integratePositions(int start, int end) {
+	integrateRange(start, end, stepScale,
+		boundsSize.x*0.5f-particleSize, boundsSize.y*0.5f-particleSize, -collisionDamping,
+		particles.x, particles.y, particles.vx, particles.vy,
+		viscosityX.data(), viscosityY.data());
+}
+
+static unsigned int spreadBits(unsigned int v) {
+	v&=0xffff;
+	v=(v|(v<<8))&0x00ff00ff;
+	v=(v|(v<<4))&0x0f0f0f0f;
+	v=(v|(v<<2))&0x33333333;
+	v=(v|(v<<1))&0x55555555;
+	return v;
+}
+
+static unsigned int mortonCode(unsigned int x, unsigned int y) {
+	return spreadBits(x)|(spreadBits(y)<<1);
+}
+
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::reorderParticles() {
+	if (reorderOrder==ParticleOrder::CellKey) {
+		const std::vector<SpatialLookupEntry>& entries=spatialLookup.GetEntries();
+		PARALLEL_FOR_BEGIN(numParticles) {
+			permutation[i]=entries[i].particleIndex;
+		}PARALLEL_FOR_END();
+	} else {
+		float cellSize=smoothingRadius;
+		int maxCellX=std::min((int)(boundsSize.x/cellSize), 0xffff);
+		int maxCellY=std::min((int)(boundsSize.y/cellSize), 0xffff);
+		PARALLEL_FOR_BEGIN(numParticles) {
+			int cellX=(int)floorf((particles.x[i]+boundsSize.x*0.5f)/cellSize);
+			int cellY=(int)floorf((particles.y[i]+boundsSize.y*0.5f)/cellSize);
+			cellX=std::min(std::max(cellX, 0), maxCellX);
+			cellY=std::min(std::max(cellY, 0), maxCellY);
+			reorderKeys[i]=(SpatialLookupEntry){i, mortonCode(cellX, cellY)};
+		}PARALLEL_FOR_END();
+		RadixSortEntries(reorderKeys, reorderScratch, reorderHistograms, mortonCode(maxCellX, maxCellY));
+		PARALLEL_FOR_BEGIN(numParticles) {
+			permutation[i]=reorderKeys[i].particleIndex;
+		}PARALLEL_FOR_END();
 	}
+
+	// Sized on first use, so runs that never reorder never allocate it.
+	if (reorderBuffer.Size()!=numParticles)
+		reorderBuffer.Resize(numParticles);
+	reorderBuffer.PermuteFrom(particles, permutation.data());
+	particles.Swap(reorderBuffer);
+	// The cached lists and the grid entries hold slot indices.
+	verletValid=false;
+	spatialLookup.Invalidate();
+	PARALLEL_FOR_BEGIN(numParticles) {
+		particleSlots[particles.id[i]]=i;
+	}PARALLEL_FOR_END();
 }
 
-float FluidSimulation::smoothingKernel(float distance) {
-	if (distance>=smoothingRadius) return 0;
-	float volume=PI*pow(smoothingRadius,4)/6;
-	return (smoothingRadius-distance)*(smoothingRadius-distance)/volume;
+// Lists built with a skin stay complete while no particle has moved more than
+// half the skin: two particles can then have closed by at most the skin.
+template <typename Kernels>
+bool BasicFluidSimulation<Kernels>::neighboursNeedRebuild() {
+	float radius=smoothingRadius+verletSkin;
+	if (!verletValid || verletRadius!=radius || verletPairwise!=pairwiseActive)
+		return true;
+	float sqrDisplacement=parallel_reduce(numParticles, 0.f, [&](int start, int end) {
+		float partial=0;
+		for (int i=start; i<end; i++) {
+			float dx=particles.predictedX[i]-verletX[i];
+			float dy=particles.predictedY[i]-verletY[i];
+			partial=std::max(partial, dx*dx+dy*dy);
+		}
+		return partial;
+	}, [](float a, float b) { return std::max(a, b); });
+	verletStats.maxDisplacement=sqrtf(sqrDisplacement);
+	return verletStats.maxDisplacement>verletSkin*0.5f;
 }
 
-float FluidSimulation::viscositySmoothingKernel(float distance) {
-	if (distance>=smoothingRadius) return 0;
-	float volume=4 / (PI * pow(smoothingRadius, 8));
-	float v=smoothingRadius*smoothingRadius-distance*distance;
-	return v*v*volume;
+// Rebuilds the grid, and the neighbour lists when cached, from the predicted
+// positions. In Verlet mode a still-valid list only has its distances
+// refreshed; entries beyond smoothingRadius are skipped by the passes.
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::updateNeighbours() {
+	bool verlet=useNeighbourCache && verletSkin>0;
+	if (verlet) {
+		verletStats.steps++;
+		SPH_PHASE_TIMER(&phaseTimings, SimulationPhase::NeighbourCheck);
+		verletStats.rebuilt=neighboursNeedRebuild();
+		if (!verletStats.rebuilt) {
+			neighbourList.RefreshDistances(particles.predictedX, particles.predictedY, numParticles);
+			passStats.neighbours=GetLastParallelForStats();
+			return;
+		}
+	}
+
+	float radius=verlet?smoothingRadius+verletSkin:smoothingRadius;
+	// The radix sort is stable, so the neighbour order, and with it every
+	// per-particle sum, is fixed by the particle order alone.
+	spatialLookup.SetSortMode(deterministic?SpatialSortMode::Radix:sortMode);
+	spatialLookup.SetGridMode(gridMode);
+	spatialLookup.SetBounds(Vector2Scale(boundsSize, -0.5f), boundsSize);
+	spatialLookup.SetIncremental(incrementalGrid, gridMigrationThreshold);
+	spatialLookup.SetPhaseTimings(&phaseTimings);
+	spatialLookup.UpdateSpatialLookup(particles.predictedX, particles.predictedY, radius);
+	if (!useNeighbourCache) return;
+	{
+		SPH_PHASE_TIMER(&phaseTimings, SimulationPhase::Neighbours);
+		neighbourList.Build(spatialLookup, particles.predictedX, particles.predictedY, numParticles, pairwiseActive);
+		passStats.neighbours=GetLastParallelForStats();
+	}
+	if (verlet) {
+		verletX.assign(particles.predictedX, particles.predictedX+numParticles);
+		verletY.assign(particles.predictedY, particles.predictedY+numParticles);
+		verletValid=true;
+		verletRadius=radius;
+		verletPairwise=pairwiseActive;
+		verletStats.rebuilds++;
+		verletStats.maxDisplacement=0;
+	}
 }
 
-float FluidSimulation::smoothingKernelDerivative(float distance) {
-	if (distance>=smoothingRadius) return 0;
-	return (distance-smoothingRadius)*12/(smoothingRadius*smoothingRadius*smoothingRadius*smoothingRadius*PI);
+// Calls callable(index, offset, distance) for every neighbour of particleIdx,
+// from the cached lists when enabled and the grid otherwise.
+template <typename Kernels>
+template <typename Callable>
+void BasicFluidSimulation<Kernels>::forEachNeighbour(int particleIdx, Callable&& callable) {
+	Vector2 position=particles.GetPredictedPosition(particleIdx);
+	if (useNeighbourCache) {
+		const float* predictedX=particles.predictedX;
+		const float* predictedY=particles.predictedY;
+		float radius=smoothingRadius;
+		neighbourList.ForEachNeighbour(particleIdx, [&](int otherParticleIdx, float distance) {
+			if (distance>=radius) return;
+			Vector2 offset=(Vector2){predictedX[otherParticleIdx]-position.x, predictedY[otherParticleIdx]-position.y};
+			callable(otherParticleIdx, offset, distance);
+		});
+	} else {
+		spatialLookup.ForEachNeighbour(position, [&](int otherParticleIdx, Vector2 offset, float sqrDist) {
+			callable(otherParticleIdx, offset, sqrtf(sqrDist));
+		});
+	}
 }
 
-float FluidSimulation::calculateDensity(Vector2 sampleParticle) {
+// Calls callable(index, offset, distance) once for each pair in particleIdx's
+// forward half-stencil. With the neighbour cache on, this needs the list built
+// forward-only.
+template <typename Kernels>
+template <typename Callable>
+void BasicFluidSimulation<Kernels>::forEachForwardNeighbour(int particleIdx, Callable&& callable) {
+	if (useNeighbourCache) {
+		Vector2 position=particles.GetPredictedPosition(particleIdx);
+		const float* predictedX=particles.predictedX;
+		const float* predictedY=particles.predictedY;
+		float radius=smoothingRadius;
+		neighbourList.ForEachNeighbour(particleIdx, [&](int otherParticleIdx, float distance) {
+			if (distance>=radius) return;
+			Vector2 offset=(Vector2){predictedX[otherParticleIdx]-position.x, predictedY[otherParticleIdx]-position.y};
+			callable(otherParticleIdx, offset, distance);
+		});
+	} else {
+		spatialLookup.ForEachForwardNeighbour(particleIdx, [&](int otherParticleIdx, Vector2 offset, float sqrDist) {
+			callable(otherParticleIdx, offset, sqrtf(sqrDist));
+		});
+	}
+}
+
+// Calls callable(indices, stride, count) for each span of candidate
+// neighbours the SIMD kernels should scan.
+template <typename Kernels>
+template <typename Callable>
+void BasicFluidSimulation<Kernels>::forEachCandidateSpan(int particleIdx, Callable&& callable) {
+	if (useNeighbourCache)
+		callable(neighbourList.Indices(particleIdx), 1, neighbourList.Count(particleIdx));
+	else
+		spatialLookup.ForEachCandidateSpan(particles.GetPredictedPosition(particleIdx), callable);
+}
+
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::updateKernels() {
+	if (densityKernel.radius==smoothingRadius) return;
+	densityKernel.SetRadius(smoothingRadius);
+	gradientKernel.SetRadius(smoothingRadius);
+	viscosityKernel.SetRadius(smoothingRadius);
+}
+
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::updateSimdParams() {
+	// The vector kernels hard-code the default kernel shapes.
+	if constexpr (std::is_same<Kernels, DefaultKernels>::value) {
+		simdActive=useSimd && SimdKernelsSupported();
+		simdParams.radius=smoothingRadius;
+		simdParams.densityScale=mass*densityKernel.scale;
+		simdParams.gradientScale=gradientKernel.scale;
+		simdParams.viscosityScale=viscosityKernel.scale;
+		simdParams.mass=mass;
+	} else {
+		simdActive=false;
+	}
+}
+
+template <typename Kernels>
+float BasicFluidSimulation<Kernels>::calculateDensity(int particleIdx) {
 	float density=0.f;
 
-	std::vector<int> particlesWithinRadius=spatialLookup.GetPointsWithinRadius(sampleParticle);
-	for (int i : particlesWithinRadius) {
-		float distance=Vector2Distance(sampleParticle, positions[i]);
-		float influence=smoothingKernel(distance);
-		density+=influence*mass;
+	if (simdActive) {
+		Vector2 position=particles.GetPredictedPosition(particleIdx);
+		forEachCandidateSpan(particleIdx, [&](const int* indices, int stride, int count) {
+			density+=SimdDensity(simdParams, indices, stride, count, particles.predictedX, particles.predictedY, position);
+		});
+		return density;
 	}
 
+	forEachNeighbour(particleIdx, [&](int, Vector2, float distance) {
+		float influence=densityKernel(distance);
+		density+=influence*mass;
+	});
+
 	return density;
 }
 
-Vector2 getRandomDirection() {
-	int degrees=GetRandomValue(0, 359);
+static Vector2 getRandomDirection(unsigned int bits) {
+	int degrees=randomValue(bits, 0, 359);
 	float radians=PI*degrees/180;
 	Vector2 result=(Vector2){
 		cos(radians),
@@ -100,22 +567,44 @@ Vector2 getRandomDirection() {
 	return result;
 }
 
-Vector2 FluidSimulation::calculatePressureForce(int particleIdx) {
+template <typename Kernels>
+Vector2 BasicFluidSimulation<Kernels>::pressureContribution(int otherParticleIdx, Vector2 direction, float distance, float otherPressure) {
+	float influenceMagnitude=gradientKernel(distance);
+	float sharedPressure=(particles.pressure[otherParticleIdx]+otherPressure)/2;
+	float scalar=sharedPressure*influenceMagnitude*mass*particles.invDensity[otherParticleIdx];
+	return Vector2Scale(direction,scalar);
+}
+
+template <typename Kernels>
+Vector2 BasicFluidSimulation<Kernels>::calculatePressureForce(int particleIdx) {
 	Vector2 pressureForce=(Vector2){0, 0};
-	std::vector<int> particlesWithinRadius=spatialLookup.GetPointsWithinRadius(predictedPositions[particleIdx]);
-	for (int otherParticleIdx : particlesWithinRadius) {
-		if (otherParticleIdx==particleIdx) continue;
-		Vector2 difference=Vector2Subtract(predictedPositions[otherParticleIdx],predictedPositions[particleIdx]);
-		float distance=Vector2Length(difference);
-		Vector2 direction=distance==0?getRandomDirection():Vector2Scale(difference,1.f/distance);
-		float influenceMagnitude=smoothingKernelDerivative(distance);
-		float density=densities[otherParticleIdx];
-		float pressure=densityToPressure(density);
-		float otherPressure=densityToPressure(densities[particleIdx]);
-		float sharedPressure=(pressure+otherPressure)/2;
-		float scalar=sharedPressure*influenceMagnitude*mass/density;
-		pressureForce=Vector2Add(pressureForce, Vector2Scale(direction,scalar));
+	float otherPressure=particles.pressure[particleIdx];
+
+	if (simdActive) {
+		Vector2 position=particles.GetPredictedPosition(particleIdx);
+		int coincident=0;
+		forEachCandidateSpan(particleIdx, [&](const int* indices, int stride, int count) {
+			pressureForce=Vector2Add(pressureForce, SimdPressureForce(simdParams, indices, stride, count,
+				particles.predictedX, particles.predictedY, particles.pressure, particles.invDensity,
+				particleIdx, position, otherPressure, coincident));
+		});
+		if (coincident==0) return pressureForce;
+		// Rare: neighbours sitting exactly on top of this particle get a random push.
+		forEachNeighbour(particleIdx, [&](int otherParticleIdx, Vector2, float distance) {
+			if (otherParticleIdx==particleIdx || distance!=0) return;
+			pressureForce=Vector2Add(pressureForce, pressureContribution(otherParticleIdx,
+				getRandomDirection(randomBits(particles.id[particleIdx], particles.id[otherParticleIdx])), distance, otherPressure));
+		});
+		return pressureForce;
 	}
+
+	forEachNeighbour(particleIdx, [&](int otherParticleIdx, Vector2 difference, float distance) {
+		if (otherParticleIdx==particleIdx) return;
+		Vector2 direction=distance==0?
+			getRandomDirection(randomBits(particles.id[particleIdx], particles.id[otherParticleIdx])):
+			Vector2Scale(difference,1.f/distance);
+		pressureForce=Vector2Add(pressureForce, pressureContribution(otherParticleIdx, direction, distance, otherPressure));
+	});
 	return pressureForce;
 }
 
@@ -123,80 +612,315 @@ template <typename T> int sgn(T val) {
     return (T(0) < val) - (val < T(0));
 }
 
-Vector2 FluidSimulation::calculateMouseForce(int particleIdx, Vector2 mousePos, float strength) {
+template <typename Kernels>
+Vector2 BasicFluidSimulation<Kernels>::calculateMouseForce(int particleIdx, Vector2 mousePos, float strength) {
 	Vector2 force=(Vector2){0,0};
-	Vector2 offset=Vector2Subtract(mousePos, positions[particleIdx]);
+	Vector2 offset=Vector2Subtract(mousePos, particles.GetPosition(particleIdx));
 	float distance=Vector2Length(offset);
 	if (distance<mouseRadius) {
 		Vector2 directionToMouse=distance<=std::numeric_limits<float>::epsilon()?(Vector2){0,0}:Vector2Scale(offset,1/distance);
 		float distDependantStrength=distance/mouseRadius;
-		force=Vector2Add(force,Vector2Scale(Vector2Subtract(Vector2Scale(directionToMouse,strength),velocities[particleIdx]),distDependantStrength));
+		force=Vector2Add(force,Vector2Scale(Vector2Subtract(Vector2Scale(directionToMouse,strength),particles.GetVelocity(particleIdx)),distDependantStrength));
 	}
 	return force;
 }
 
-Vector2 FluidSimulation::calculateViscosityForce(int particleIdx) {
+template <typename Kernels>
+Vector2 BasicFluidSimulation<Kernels>::calculateViscosityForce(int particleIdx) {
 	Vector2 force=(Vector2){0,0};
-	Vector2 position=positions[particleIdx];
-	std::vector<int> particlesWithinRadius=spatialLookup.GetPointsWithinRadius(predictedPositions[particleIdx]);
-	for (int otherParticleIdx : particlesWithinRadius) {
-		float dist=Vector2Distance(positions[otherParticleIdx],position);
-		float influence=viscositySmoothingKernel(dist);
-		force=Vector2Add(force,Vector2Scale(Vector2Subtract(velocities[otherParticleIdx], velocities[particleIdx]),influence));
+	Vector2 velocity=particles.GetVelocity(particleIdx);
+	if (simdActive) {
+		Vector2 position=particles.GetPredictedPosition(particleIdx);
+		forEachCandidateSpan(particleIdx, [&](const int* indices, int stride, int count) {
+			force=Vector2Add(force, SimdViscosityForce(simdParams, indices, stride, count,
+				particles.predictedX, particles.predictedY, particles.vx, particles.vy, position, velocity));
+		});
+		return Vector2Scale(force,viscosityStrength);
 	}
+	forEachNeighbour(particleIdx, [&](int otherParticleIdx, Vector2, float distance) {
+		float influence=viscosityKernel(distance);
+		force=Vector2Add(force,Vector2Scale(Vector2Subtract(particles.GetVelocity(otherParticleIdx), velocity),influence));
+	});
 	return Vector2Scale(force,viscosityStrength);
 }
 
-int FluidSimulation::findClosestParticle() {
+template <typename Kernels>
+int BasicFluidSimulation<Kernels>::findClosestParticle() {
 	int j=0;
 	float bestDst=100000;
 	for (int i=0; i<numParticles; i++) {
-		Vector2 mousePosition=Vector2Subtract(
-			GetMousePosition(),
-			Vector2Scale(boundsSize, 0.5f)
-		);
-		mousePosition.y=-mousePosition.y;
-		float distanceToParticle=Vector2Distance(mousePosition,positions[i]);
+		float distanceToParticle=Vector2Distance(mousePosition,particles.GetPosition(i));
 		if (distanceToParticle<bestDst) {
 			j=i;
 			bestDst=distanceToParticle;
 		}
 	}
-	return j;
+	return particles.id[j];
 }
 
-void FluidSimulation::SimulationStep(float deltaTime) {
-	PARALLEL_FOR_BEGIN(numParticles) {
-		velocities[i].y-=gravity*deltaTime;
-		predictedPositions[i]=Vector2Add(positions[i],Vector2Scale(velocities[i],0.5f));
-	}PARALLEL_FOR_END();
+// Adds the pressure and mouse forces to particleIdx's velocity.
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::applyPressureForce(int particleIdx, Vector2 pressureForce, float deltaTime) {
+	Vector2 acceleration=Vector2Scale(pressureForce,particles.invDensity[particleIdx]);
+	sqrAccelerations[particleIdx]=Vector2LengthSqr(acceleration);
+	Vector2 velocity=particles.GetVelocity(particleIdx);
+	velocity=Vector2Add(velocity, Vector2Scale(calculateMouseForce(particleIdx,mousePosition,50*forceType),mouseFlag*deltaTime));
+	velocity=Vector2Add(velocity, Vector2Scale(acceleration,deltaTime));
+	particles.SetVelocity(particleIdx, velocity);
+}
 
-	spatialLookup.UpdateSpatialLookup(predictedPositions, smoothingRadius);
+// Every pair adds its kernel value to both densities; the forward stencil
+// leaves out each particle itself.
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::calculateDensitiesPairwise() {
+	pairAccumulator.Reset(numParticles, 1);
+	parallel_for(numParticles, [&](int start, int end) {
+		float* density=pairAccumulator.Local();
+		for (int i=start; i<end; i++) {
+			forEachForwardNeighbour(i, [&](int j, Vector2, float distance) {
+				float contribution=densityKernel(distance)*mass;
+				density[i]+=contribution;
+				density[j]+=contribution;
+			});
+		}
+	});
+	passStats.density=GetLastParallelForStats();
 
+	float selfDensity=densityKernel(0)*mass;
 	PARALLEL_FOR_BEGIN(numParticles) {
-		densities[i]=calculateDensity(predictedPositions[i]);
+		setDensity(i, selfDensity+pairAccumulator.Sum(0, i));
 	}PARALLEL_FOR_END();
+}
+
+// Pressure and viscosity with each pair evaluated once. The shared pressure
+// and kernel gradient are common to both sides, which differ only in
+// direction and in dividing by the other particle's density; the viscosity
+// term is exactly equal and opposite.
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::calculateForcesPairwise(float deltaTime) {
+	pairAccumulator.Reset(numParticles, 2);
+	size_t stride=pairAccumulator.Stride();
+	parallel_for(numParticles, [&](int start, int end) {
+		float* forceX=pairAccumulator.Local();
+		float* forceY=forceX+stride;
+		for (int i=start; i<end; i++) {
+			float pressure=particles.pressure[i];
+			float invDensity=particles.invDensity[i];
+			forEachForwardNeighbour(i, [&](int j, Vector2 offset, float distance) {
+				Vector2 direction=distance==0?
+					getRandomDirection(randomBits(particles.id[i], particles.id[j])):
+					Vector2Scale(offset,1.f/distance);
+				float otherInvDensity=particles.invDensity[j];
+				float sharedPressure=(pressure+particles.pressure[j])/2;
+				Vector2 force=Vector2Scale(direction, sharedPressure*gradientKernel(distance)*mass);
+				forceX[i]+=force.x*otherInvDensity;
+				forceY[i]+=force.y*otherInvDensity;
+				forceX[j]-=force.x*invDensity;
+				forceY[j]-=force.y*invDensity;
+			});
+		}
+	});
+	passStats.forces=GetLastParallelForStats();
 
-	Vector2 mousePosition=Vector2Subtract(
-		GetMousePosition(),
-		Vector2Scale(boundsSize, 0.5f)
-	);
-	mousePosition.y=-mousePosition.y;
 	PARALLEL_FOR_BEGIN(numParticles) {
-		Vector2 pressureForce=calculatePressureForce(i);
-		Vector2 acceleration=Vector2Scale(pressureForce,1.f/densities[i]);
-		velocities[i]=Vector2Add(velocities[i], Vector2Scale(calculateMouseForce(i,mousePosition,50*forceType),mouseFlag*deltaTime));
-		velocities[i]=Vector2Add(velocities[i], Vector2Scale(acceleration,deltaTime));
-		velocities[i]=Vector2Add(velocities[i], Vector2Scale(calculateViscosityForce(i),deltaTime));
+		applyPressureForce(i, (Vector2){pairAccumulator.Sum(0, i), pairAccumulator.Sum(1, i)}, deltaTime);
 	}PARALLEL_FOR_END();
 
+	pairAccumulator.Reset(numParticles, 2);
+	parallel_for(numParticles, [&](int start, int end) {
+		float* forceX=pairAccumulator.Local();
+		float* forceY=forceX+stride;
+		for (int i=start; i<end; i++) {
+			Vector2 velocity=particles.GetVelocity(i);
+			forEachForwardNeighbour(i, [&](int j, Vector2, float distance) {
+				Vector2 force=Vector2Scale(Vector2Subtract(particles.GetVelocity(j), velocity), viscosityKernel(distance));
+				forceX[i]+=force.x;
+				forceY[i]+=force.y;
+				forceX[j]-=force.x;
+				forceY[j]-=force.y;
+			});
+		}
+	});
+	passStats.viscosity=GetLastParallelForStats();
+
+	float viscosityScale=viscosityStrength*deltaTime;
 	PARALLEL_FOR_BEGIN(numParticles) {
-		positions[i] = Vector2Add(positions[i], velocities[i]);
-		resolveCollisions(positions[i], velocities[i]);
+		viscosityX[i]=pairAccumulator.Sum(0, i)*viscosityScale;
+		viscosityY[i]=pairAccumulator.Sum(1, i)*viscosityScale;
 	}PARALLEL_FOR_END();
 }
 
-void FluidSimulation::Render() {
-	for (int i=0; i<numParticles; i++)
-		DrawCircleV(positions[i], particleSize, (Color){0, 0, 255, 255});
+typedef struct MaxMotion {
+	float sqrSpeed;
+	float sqrAcceleration;
+} MaxMotion;
+
+// Velocities are in distance per reference step and accelerations change them
+// per second, so a step of dt moves a particle v*dt/ref plus a*dt^2/ref. Both
+// terms are held to courantNumber smoothing radii. Accelerations are the
+// pressure accelerations of the previous step plus gravity.
+template <typename Kernels>
+float BasicFluidSimulation<Kernels>::chooseTimestep(float maxDeltaTime) {
+	MaxMotion motion=parallel_reduce(numParticles, (MaxMotion){0, 0}, [&](int start, int end) {
+		MaxMotion partial=(MaxMotion){0, 0};
+		for (int i=start; i<end; i++) {
+			partial.sqrSpeed=std::max(partial.sqrSpeed, particles.vx[i]*particles.vx[i]+particles.vy[i]*particles.vy[i]);
+			partial.sqrAcceleration=std::max(partial.sqrAcceleration, sqrAccelerations[i]);
+		}
+		return partial;
+	}, [](MaxMotion a, MaxMotion b) {
+		return (MaxMotion){std::max(a.sqrSpeed, b.sqrSpeed), std::max(a.sqrAcceleration, b.sqrAcceleration)};
+	});
+
+	float maxDistance=courantNumber*smoothingRadius;
+	float maxSpeed=sqrtf(motion.sqrSpeed);
+	float maxAcceleration=sqrtf(motion.sqrAcceleration)+fabsf(gravity);
+	float velocityLimit=maxSpeed>0?maxDistance*referenceTimestep/maxSpeed:maxDeltaTime;
+	float accelerationLimit=maxAcceleration>0?sqrtf(maxDistance*referenceTimestep/maxAcceleration):maxDeltaTime;
+
+	timestepStats.maxSpeed=maxSpeed;
+	timestepStats.maxAcceleration=maxAcceleration;
+	timestepStats.velocityLimit=velocityLimit;
+	timestepStats.accelerationLimit=accelerationLimit;
+	// The caller's cap wins over minTimestep.
+	return std::min(maxDeltaTime, std::max(minTimestep, std::min(velocityLimit, accelerationLimit)));
 }
+
+template <typename Kernels>
+float BasicFluidSimulation<Kernels>::SimulationStep(float deltaTime) {
+	if (reorderInterval>0 && stepCount%reorderInterval==0)
+		reorderParticles();
+	stepCount++;
+	updateKernels();
+	updateSimdParams();
+	stepScale=1.f;
+	if (adaptiveTimestep) {
+		deltaTime=chooseTimestep(deltaTime);
+		stepScale=deltaTime/referenceTimestep;
+	}
+	timestepStats.deltaTime=deltaTime;
+
+	{
+		SPH_PHASE_TIMER(&phaseTimings, SimulationPhase::Predict);
+		parallel_for(numParticles, [&](int start, int end) {
+			predictPositions(start, end, deltaTime);
+		});
+		passStats.predict=GetLastParallelForStats();
+	}
+
+	// Which thread handles a pair varies with scheduling, so the pairwise sums
+	// are not reproducible and deterministic mode keeps per-particle passes.
+	pairwiseActive=pairwiseForces && !deterministic;
+	updateNeighbours();
+
+	if (pairwiseActive) {
+		{
+			SPH_PHASE_TIMER(&phaseTimings, SimulationPhase::Density);
+			calculateDensitiesPairwise();
+		}
+		SPH_PHASE_TIMER(&phaseTimings, SimulationPhase::Forces);
+		calculateForcesPairwise(deltaTime);
+	} else {
+		{
+			SPH_PHASE_TIMER(&phaseTimings, SimulationPhase::Density);
+			PARALLEL_FOR_BEGIN(numParticles) {
+				setDensity(i, calculateDensity(i));
+			}PARALLEL_FOR_END();
+			passStats.density=GetLastParallelForStats();
+		}
+
+		SPH_PHASE_TIMER(&phaseTimings, SimulationPhase::Forces);
+		PARALLEL_FOR_BEGIN(numParticles) {
+			applyPressureForce(i, calculatePressureForce(i), deltaTime);
+		}PARALLEL_FOR_END();
+		passStats.forces=GetLastParallelForStats();
+
+		// Viscosity reads the neighbours' velocities, so its change is kept
+		// aside and applied by the integrate pass rather than racing with the
+		// neighbours' own updates.
+		PARALLEL_FOR_BEGIN(numParticles) {
+			Vector2 viscosity=Vector2Scale(calculateViscosityForce(i),deltaTime);
+			viscosityX[i]=viscosity.x;
+			viscosityY[i]=viscosity.y;
+		}PARALLEL_FOR_END();
+		passStats.viscosity=GetLastParallelForStats();
+	}
+
+	SPH_PHASE_TIMER(&phaseTimings, SimulationPhase::Integrate);
+	parallel_for(numParticles, [&](int start, int end) {
+		integratePositions(start, end);
+	});
+	passStats.integrate=GetLastParallelForStats();
+	return deltaTime;
+}
+
+template <typename Kernels>
+const SimulationPassStats& BasicFluidSimulation<Kernels>::GetPassStats() const {
+	return passStats;
+}
+
+template <typename Kernels>
+const TimestepStats& BasicFluidSimulation<Kernels>::GetTimestepStats() const {
+	return timestepStats;
+}
+
+template <typename Kernels>
+const VerletStats& BasicFluidSimulation<Kernels>::GetVerletStats() const {
+	return verletStats;
+}
+
+template <typename Kernels>
+PhaseStats BasicFluidSimulation<Kernels>::GetPhaseStats(SimulationPhase phase) const {
+	return phaseTimings.GetStats(phase);
+}
+
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::ClearPhaseStats() {
+	phaseTimings.Clear();
+	spatialLookup.ResetQueryStats();
+	spatialLookup.ResetUpdateStats();
+}
+
+template <typename Kernels>
+SpatialUpdateStats BasicFluidSimulation<Kernels>::GetSpatialUpdateStats() const {
+	return spatialLookup.GetUpdateStats();
+}
+
+template <typename Kernels>
+SpatialQueryStats BasicFluidSimulation<Kernels>::GetSpatialQueryStats() const {
+	return spatialLookup.GetQueryStats();
+}
+
+template <typename Kernels>
+size_t BasicFluidSimulation<Kernels>::GetNeighbourCacheBytes() const {
+	return neighbourList.MemoryBytes();
+}
+
+template <typename Kernels>
+float BasicFluidSimulation<Kernels>::GetKineticEnergy() const {
+	float sqrSpeed=parallel_reduce(numParticles, 0.f, [&](int start, int end) {
+		float sum=0;
+		for (int i=start; i<end; i++)
+			sum+=particles.vx[i]*particles.vx[i]+particles.vy[i]*particles.vy[i];
+		return sum;
+	}, [](float a, float b) { return a+b; });
+	return 0.5f*mass*sqrSpeed;
+}
+
+template <typename Kernels>
+unsigned long long BasicFluidSimulation<Kernels>::GetStepCount() const {
+	return stepCount;
+}
+
+template <typename Kernels>
+const ParticleData& BasicFluidSimulation<Kernels>::GetParticles() const {
+	return particles;
+}
+
+template <typename Kernels>
+int BasicFluidSimulation<Kernels>::GetParticleSlot(int id) const {
+	return particleSlots[id];
+}
+
+template class BasicFluidSimulation<DefaultKernels>;
+template class BasicFluidSimulation<SpikyPow3Kernels>;
@@ -0,0 +1,12 @@
+#include "include/FluidSimulation.hpp"
+
+template <typename Kernels>
+void BasicFluidSimulation<Kernels>::Render(float alpha) {
+	for (int i=0; i<numParticles; i++) {
+		Vector2 position=Vector2Lerp(particles.GetPreviousPosition(i), particles.GetPosition(i), alpha);
+		DrawCircleV(position, particleSize, (Color){0, 0, 255, 255});
+	}
+}
+
+template void BasicFluidSimulation<DefaultKernels>::Render(float alpha);
+template void BasicFluidSimulation<SpikyPow3Kernels>::Render(float alpha);
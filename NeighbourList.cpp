@@ -0,0 +1,53 @@
+#include "include/NeighbourList.hpp"
+
+void NeighbourList::Build(const SpatialLookup& spatialLookup, const float* pointsX, const float* pointsY, int numPoints, bool forwardOnly) {
+	offsets.resize(numPoints+1);
+	auto forEach=[&](int i, auto&& callable) {
+		if (forwardOnly)
+			spatialLookup.ForEachForwardNeighbour(i, callable);
+		else
+			spatialLookup.ForEachNeighbour((Vector2){pointsX[i], pointsY[i]}, callable);
+	};
+
+	PARALLEL_FOR_BEGIN(numPoints) {
+		int count=0;
+		forEach(i, [&](int, Vector2, float) { count++; });
+		offsets[i+1]=count;
+	}PARALLEL_FOR_END();
+
+	offsets[0]=0;
+	for (int i=0; i<numPoints; i++)
+		offsets[i+1]+=offsets[i];
+	if ((size_t)offsets[numPoints]>indices.size()) {
+		indices.resize(offsets[numPoints]);
+		distances.resize(offsets[numPoints]);
+	}
+
+	PARALLEL_FOR_BEGIN(numPoints) {
+		int k=offsets[i];
+		forEach(i, [&](int particleIdx, Vector2, float sqrDist) {
+			indices[k]=particleIdx;
+			distances[k]=sqrtf(sqrDist);
+			k++;
+		});
+	}PARALLEL_FOR_END();
+}
+
+void NeighbourList::RefreshDistances(const float* pointsX, const float* pointsY, int numPoints) {
+	PARALLEL_FOR_BEGIN(numPoints) {
+		float x=pointsX[i], y=pointsY[i];
+		for (int k=offsets[i]; k<offsets[i+1]; k++) {
+			float dx=pointsX[indices[k]]-x;
+			float dy=pointsY[indices[k]]-y;
+			distances[k]=sqrtf(dx*dx+dy*dy);
+		}
+	}PARALLEL_FOR_END();
+}
+
+size_t NeighbourList::NumPairs() const {
+	return offsets.empty()?0:offsets.back();
+}
+
+size_t NeighbourList::MemoryBytes() const {
+	return offsets.capacity()*sizeof(int)+indices.capacity()*sizeof(int)+distances.capacity()*sizeof(float);
+}
@@ -0,0 +1,14 @@
+#include "include/PairwiseAccumulator.hpp"
+
+PairwiseAccumulator::PairwiseAccumulator() : stride(0), numThreads(0), numComponents(0) {}
+
+void PairwiseAccumulator::Reset(unsigned count, unsigned components) {
+	numThreads=GetNumThreads();
+	numComponents=components;
+	stride=count;
+	size_t total=(size_t)numThreads*numComponents*stride;
+	if (values.size()<total) values.resize(total);
+	parallel_for(total, [&](int start, int end) {
+		std::fill(values.begin()+start, values.begin()+end, 0.f);
+	});
+}
@@ -0,0 +1,91 @@
+#include "include/ParticleData.hpp"
+#include "include/parallel.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+ParticleData::ParticleData() : block(nullptr), stride(0), count(0) {
+	bindFields();
+}
+
+ParticleData::~ParticleData() {
+	if (release) release();
+}
+
+void ParticleData::Resize(unsigned int newCount) {
+	if (release) release();
+	release=nullptr;
+	block=nullptr;
+	count=newCount;
+	// Round each array up to a whole number of alignment units.
+	size_t floatsPerUnit=FIELD_ALIGNMENT/sizeof(float);
+	stride=(count+floatsPerUnit-1)/floatsPerUnit*floatsPerUnit;
+	size_t bytes=stride*NUM_FIELDS*sizeof(float);
+	if (bytes>0) {
+		block=(float*)std::aligned_alloc(FIELD_ALIGNMENT, bytes);
+		if (!block) throw std::bad_alloc();
+		std::memset(block, 0, bytes);
+		float* allocated=block;
+		release=[allocated]() { std::free(allocated); };
+	}
+	bindFields();
+}
+
+void ParticleData::Adopt(float* newBlock, unsigned int newCount, size_t newStride, std::function<void()> newRelease) {
+	if (release) release();
+	block=newBlock;
+	count=newCount;
+	stride=newStride;
+	release=std::move(newRelease);
+	bindFields();
+}
+
+unsigned int ParticleData::Size() const {
+	return count;
+}
+
+size_t ParticleData::Stride() const {
+	return stride;
+}
+
+float* ParticleData::Field(int field) const {
+	return block?block+field*stride:nullptr;
+}
+
+void ParticleData::Swap(ParticleData& other) {
+	std::swap(block, other.block);
+	std::swap(stride, other.stride);
+	std::swap(count, other.count);
+	std::swap(release, other.release);
+	bindFields();
+	other.bindFields();
+}
+
+void ParticleData::PermuteFrom(const ParticleData& source, const int* order) {
+	parallel_for(count, [&](int start, int end) {
+		for (int field=0; field<ID; field++) {
+			float* dst=Field(field);
+			const float* src=source.Field(field);
+			for (int i=start; i<end; i++)
+				dst[i]=src[order[i]];
+		}
+		for (int i=start; i<end; i++)
+			id[i]=source.id[order[i]];
+	});
+}
+
+void ParticleData::bindFields() {
+	x=Field(POSITION_X);
+	y=Field(POSITION_Y);
+	predictedX=Field(PREDICTED_X);
+	predictedY=Field(PREDICTED_Y);
+	vx=Field(VELOCITY_X);
+	vy=Field(VELOCITY_Y);
+	previousX=Field(PREVIOUS_X);
+	previousY=Field(PREVIOUS_Y);
+	density=Field(DENSITY);
+	pressure=Field(PRESSURE);
+	invDensity=Field(INV_DENSITY);
+	id=(int*)Field(ID);
+}
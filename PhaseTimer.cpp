@@ -0,0 +1,55 @@
+#include "include/PhaseTimer.hpp"
+#include <algorithm>
+
+static const char* PHASE_NAMES[(int)SimulationPhase::Count]={
+	"predict",
+	"grid hash",
+	"grid sort",
+	"grid repair",
+	"grid starts",
+	"neighbours",
+	"verlet check",
+	"density",
+	"forces",
+	"integrate",
+};
+
+const char* SimulationPhaseName(SimulationPhase phase) {
+	return PHASE_NAMES[(int)phase];
+}
+
+PhaseTimings::PhaseTimings() :
+	samples((size_t)WINDOW*(int)SimulationPhase::Count) {
+	Clear();
+}
+
+void PhaseTimings::Record(SimulationPhase phase, double ns) {
+	int p=(int)phase;
+	samples[(size_t)p*WINDOW+heads[p]]=ns;
+	heads[p]=(heads[p]+1)%WINDOW;
+	counts[p]=std::min(counts[p]+1, WINDOW);
+}
+
+// Statistics are computed on query so recording stays a store and two adds.
+PhaseStats PhaseTimings::GetStats(SimulationPhase phase) const {
+	int p=(int)phase;
+	PhaseStats stats=(PhaseStats){0, 0, 0, 0, counts[p]};
+	if (counts[p]==0) return stats;
+	const double* window=&samples[(size_t)p*WINDOW];
+	double sorted[WINDOW];
+	std::copy(window, window+counts[p], sorted);
+	std::sort(sorted, sorted+counts[p]);
+	double total=0;
+	for (unsigned k=0; k<counts[p]; k++)
+		total+=sorted[k];
+	stats.minNs=sorted[0];
+	stats.meanNs=total/counts[p];
+	stats.p99Ns=sorted[std::min(counts[p]-1, (unsigned)(counts[p]*0.99))];
+	stats.lastNs=window[(heads[p]+WINDOW-1)%WINDOW];
+	return stats;
+}
+
+void PhaseTimings::Clear() {
+	std::fill(counts, counts+(int)SimulationPhase::Count, 0u);
+	std::fill(heads, heads+(int)SimulationPhase::Count, 0u);
+}
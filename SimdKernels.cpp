@@ -0,0 +1,137 @@
+#include "include/SimdKernels.hpp"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SPH_SIMD_AVX2 1
+#include <immintrin.h>
+#endif
+
+#ifdef SPH_SIMD_AVX2
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+bool SimdKernelsSupported() {
+	static const bool supported=__builtin_cpu_supports("avx2");
+	return supported;
+}
+
+AVX2_TARGET static inline float horizontalSum(__m256 v) {
+	__m128 sum=_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	sum=_mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum=_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum);
+}
+
+// Lanes [0, remaining) active; inactive lanes load index 0 so every gather
+// stays in bounds.
+AVX2_TARGET static inline __m256i loadIndices(const int* indices, int stride, int remaining, __m256i& active) {
+	const __m256i lane=_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	active=_mm256_cmpgt_epi32(_mm256_set1_epi32(remaining), lane);
+	if (stride==1 && remaining>=8)
+		return _mm256_loadu_si256((const __m256i*)indices);
+	__m256i offsets=_mm256_mullo_epi32(lane, _mm256_set1_epi32(stride));
+	return _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), indices, offsets, active, 4);
+}
+
+AVX2_TARGET float SimdDensity(const SimdKernelParams& params,
+		const int* indices, int stride, int count,
+		const float* x, const float* y, Vector2 point) {
+	const __m256 h=_mm256_set1_ps(params.radius);
+	const __m256 h2=_mm256_set1_ps(params.radius*params.radius);
+	const __m256 px=_mm256_set1_ps(point.x), py=_mm256_set1_ps(point.y);
+	__m256 sum=_mm256_setzero_ps();
+	for (int k=0; k<count; k+=8) {
+		__m256i active;
+		__m256i idx=loadIndices(indices+k*stride, stride, count-k, active);
+		__m256 dx=_mm256_sub_ps(_mm256_i32gather_ps(x, idx, 4), px);
+		__m256 dy=_mm256_sub_ps(_mm256_i32gather_ps(y, idx, 4), py);
+		__m256 d2=_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+		__m256 mask=_mm256_and_ps(_mm256_cmp_ps(d2, h2, _CMP_LT_OQ), _mm256_castsi256_ps(active));
+		__m256 t=_mm256_sub_ps(h, _mm256_sqrt_ps(d2));
+		sum=_mm256_add_ps(sum, _mm256_and_ps(mask, _mm256_mul_ps(t, t)));
+	}
+	return horizontalSum(sum)*params.densityScale;
+}
+
+AVX2_TARGET Vector2 SimdPressureForce(const SimdKernelParams& params,
+		const int* indices, int stride, int count,
+		const float* x, const float* y, const float* pressures, const float* invDensities,
+		int particleIdx, Vector2 point, float pressure, int& coincident) {
+	const __m256 h=_mm256_set1_ps(params.radius);
+	const __m256 h2=_mm256_set1_ps(params.radius*params.radius);
+	const __m256 zero=_mm256_setzero_ps();
+	const __m256 one=_mm256_set1_ps(1.f);
+	const __m256 px=_mm256_set1_ps(point.x), py=_mm256_set1_ps(point.y);
+	const __m256 gradientScale=_mm256_set1_ps(params.gradientScale*params.mass*0.5f);
+	const __m256 ownPressure=_mm256_set1_ps(pressure);
+	const __m256i self=_mm256_set1_epi32(particleIdx);
+	__m256 fx=zero, fy=zero;
+	for (int k=0; k<count; k+=8) {
+		__m256i active;
+		__m256i idx=loadIndices(indices+k*stride, stride, count-k, active);
+		__m256 dx=_mm256_sub_ps(_mm256_i32gather_ps(x, idx, 4), px);
+		__m256 dy=_mm256_sub_ps(_mm256_i32gather_ps(y, idx, 4), py);
+		__m256 d2=_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+		__m256 inRange=_mm256_and_ps(_mm256_cmp_ps(d2, h2, _CMP_LT_OQ), _mm256_castsi256_ps(active));
+		__m256 atZero=_mm256_cmp_ps(d2, zero, _CMP_EQ_OQ);
+		__m256 notSelf=_mm256_castsi256_ps(_mm256_xor_si256(_mm256_cmpeq_epi32(idx, self), _mm256_set1_epi32(-1)));
+		coincident+=__builtin_popcount(_mm256_movemask_ps(_mm256_and_ps(_mm256_and_ps(inRange, atZero), notSelf)));
+		__m256 mask=_mm256_andnot_ps(atZero, inRange);
+
+		__m256 otherPressure=_mm256_mask_i32gather_ps(zero, pressures, idx, mask, 4);
+		__m256 otherInvDensity=_mm256_mask_i32gather_ps(zero, invDensities, idx, mask, 4);
+		__m256 distance=_mm256_sqrt_ps(_mm256_blendv_ps(one, d2, mask));
+		__m256 slope=_mm256_mul_ps(_mm256_sub_ps(distance, h), gradientScale);
+		__m256 scalar=_mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(otherPressure, ownPressure), slope),
+			otherInvDensity), distance);
+		scalar=_mm256_and_ps(mask, scalar);
+		fx=_mm256_add_ps(fx, _mm256_mul_ps(dx, scalar));
+		fy=_mm256_add_ps(fy, _mm256_mul_ps(dy, scalar));
+	}
+	return (Vector2){horizontalSum(fx), horizontalSum(fy)};
+}
+
+AVX2_TARGET Vector2 SimdViscosityForce(const SimdKernelParams& params,
+		const int* indices, int stride, int count,
+		const float* x, const float* y, const float* vx, const float* vy,
+		Vector2 point, Vector2 velocity) {
+	const __m256 h2=_mm256_set1_ps(params.radius*params.radius);
+	const __m256 px=_mm256_set1_ps(point.x), py=_mm256_set1_ps(point.y);
+	const __m256 ownVx=_mm256_set1_ps(velocity.x), ownVy=_mm256_set1_ps(velocity.y);
+	__m256 fx=_mm256_setzero_ps(), fy=_mm256_setzero_ps();
+	for (int k=0; k<count; k+=8) {
+		__m256i active;
+		__m256i idx=loadIndices(indices+k*stride, stride, count-k, active);
+		__m256 dx=_mm256_sub_ps(_mm256_i32gather_ps(x, idx, 4), px);
+		__m256 dy=_mm256_sub_ps(_mm256_i32gather_ps(y, idx, 4), py);
+		__m256 d2=_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+		__m256 mask=_mm256_and_ps(_mm256_cmp_ps(d2, h2, _CMP_LT_OQ), _mm256_castsi256_ps(active));
+		__m256 v=_mm256_sub_ps(h2, d2);
+		__m256 influence=_mm256_and_ps(mask, _mm256_mul_ps(v, v));
+		fx=_mm256_add_ps(fx, _mm256_mul_ps(_mm256_sub_ps(_mm256_i32gather_ps(vx, idx, 4), ownVx), influence));
+		fy=_mm256_add_ps(fy, _mm256_mul_ps(_mm256_sub_ps(_mm256_i32gather_ps(vy, idx, 4), ownVy), influence));
+	}
+	return (Vector2){horizontalSum(fx)*params.viscosityScale, horizontalSum(fy)*params.viscosityScale};
+}
+
+#else
+
+bool SimdKernelsSupported() {
+	return false;
+}
+
+float SimdDensity(const SimdKernelParams&, const int*, int, int,
+		const float*, const float*, Vector2) {
+	return 0.f;
+}
+
+Vector2 SimdPressureForce(const SimdKernelParams&, const int*, int, int,
+		const float*, const float*, const float*, const float*, int, Vector2, float, int&) {
+	return (Vector2){0, 0};
+}
+
+Vector2 SimdViscosityForce(const SimdKernelParams&, const int*, int, int,
+		const float*, const float*, const float*, const float*, Vector2, Vector2) {
+	return (Vector2){0, 0};
+}
+
+#endif
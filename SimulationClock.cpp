@@ -0,0 +1,50 @@
+#include "include/SimulationClock.hpp"
+#include <algorithm>
+#include <cmath>
+
+SimulationClock::SimulationClock(float fixedDeltaTime, int maxStepsPerFrame) :
+	fixedDeltaTime(fixedDeltaTime), maxStepsPerFrame(maxStepsPerFrame),
+	accumulator(0), droppedTime(0) {}
+
+void SimulationClock::SetFixedDeltaTime(float deltaTime) {
+	fixedDeltaTime=deltaTime;
+	accumulator=std::min(accumulator, fixedDeltaTime);
+}
+
+float SimulationClock::GetFixedDeltaTime() const {
+	return fixedDeltaTime;
+}
+
+void SimulationClock::SetMaxStepsPerFrame(int maxSteps) {
+	maxStepsPerFrame=std::max(1, maxSteps);
+}
+
+int SimulationClock::GetMaxStepsPerFrame() const {
+	return maxStepsPerFrame;
+}
+
+int SimulationClock::Advance(float frameTime) {
+	accumulator+=std::max(0.f, frameTime);
+	int steps=std::min((int)(accumulator/fixedDeltaTime), maxStepsPerFrame);
+	accumulator-=steps*fixedDeltaTime;
+	if (accumulator>=fixedDeltaTime) {
+		// Over the cap: keep the partial step so interpolation stays smooth.
+		float excess=accumulator-fmodf(accumulator, fixedDeltaTime);
+		droppedTime+=excess;
+		accumulator-=excess;
+	}
+	return steps;
+}
+
+float SimulationClock::GetAlpha() const {
+	return std::min(1.f, accumulator/fixedDeltaTime);
+}
+
+double SimulationClock::GetDroppedTime() const {
+	return droppedTime;
+}
+
+void SimulationClock::Reset() {
+	accumulator=0;
+	droppedTime=0;
+}
@@ -0,0 +1,251 @@
+#include "include/SoftwareRenderer.hpp"
+#include "include/hsvrgb.hpp"
+#include "include/parallel.hpp"
+#include <cmath>
+#include <cstring>
+
+static const uint8_t SOLID_COLOUR[3]={0, 0, 255};
+// Smaller discs could fall between pixel centres and vanish.
+static const float MIN_RADIUS=0.71f;
+
+static bool fail(std::string* error, const std::string& message) {
+	if (error) *error=message;
+	return false;
+}
+
+SoftwareRenderer::SoftwareRenderer() : width(0), height(0), tilesX(0), tilesY(0) {
+	// Hue runs from blue at shade 0 to red at 255.
+	for (int i=0; i<256; i++) {
+		rgb colour=hsv2rgb((hsv){240.0*(255-i)/255, 1, 1});
+		palette[i][0]=(uint8_t)lround(colour.r*255);
+		palette[i][1]=(uint8_t)lround(colour.g*255);
+		palette[i][2]=(uint8_t)lround(colour.b*255);
+	}
+}
+
+void SoftwareRenderer::Resize(int newWidth, int newHeight) {
+	width=std::max(newWidth, 1);
+	height=std::max(newHeight, 1);
+	tilesX=(width+TILE_SIZE-1)/TILE_SIZE;
+	tilesY=(height+TILE_SIZE-1)/TILE_SIZE;
+	pixels.assign((size_t)width*height*3, 0);
+	tileStarts.assign((size_t)tilesX*tilesY+1, 0);
+}
+
+int SoftwareRenderer::Width() const {
+	return width;
+}
+
+int SoftwareRenderer::Height() const {
+	return height;
+}
+
+const uint8_t* SoftwareRenderer::Pixels() const {
+	return pixels.data();
+}
+
+// Moves every particle to image space and picks its shade.
+void SoftwareRenderer::project(const ParticleData& particles, float scale, float alpha,
+		ParticleColouring colouring, float colourRange) {
+	unsigned int count=particles.Size();
+	screenX.resize(count);
+	screenY.resize(count);
+	shades.resize(count);
+	bool bySpeed=colouring==ParticleColouring::Speed;
+	auto colourValue=[&](int i) {
+		return bySpeed?sqrtf(particles.vx[i]*particles.vx[i]+particles.vy[i]*particles.vy[i]):particles.density[i];
+	};
+	if (colouring!=ParticleColouring::Solid && colourRange<=0)
+		colourRange=parallel_reduce(count, 0.f,
+			[&](int start, int end) {
+				float largest=0;
+				for (int i=start; i<end; i++)
+					largest=std::max(largest, colourValue(i));
+				return largest;
+			},
+			[](float a, float b) { return std::max(a, b); });
+	float shadeScale=colourRange>0?255/colourRange:0;
+
+	float centreX=width*0.5f, centreY=height*0.5f;
+	PARALLEL_FOR_BEGIN(count) {
+		float x=particles.previousX[i]+(particles.x[i]-particles.previousX[i])*alpha;
+		float y=particles.previousY[i]+(particles.y[i]-particles.previousY[i])*alpha;
+		screenX[i]=centreX+x*scale;
+		screenY[i]=centreY-y*scale;
+		if (colouring!=ParticleColouring::Solid)
+			shades[i]=(uint8_t)std::min(colourValue(i)*shadeScale, 255.f);
+	}PARALLEL_FOR_END();
+}
+
+// First and last pixel whose centre is at or inside edge. Rounds with integer
+// conversions: without SSE4.1 floorf and ceilf are library calls, and there
+// are several per particle. Edges are clamped well inside int range first.
+static int firstPixel(float edge) {
+	float v=std::min(1e7f, std::max(-1e7f, edge-0.5f));
+	int i=(int)v;
+	return i+(v>i);
+}
+
+static int lastPixel(float edge) {
+	float v=std::min(1e7f, std::max(-1e7f, edge-0.5f));
+	int i=(int)v;
+	return i-(v<i);
+}
+
+// Tiles [first, last] along one axis holding the pixel centres a disc covers;
+// empty when it covers none on the image.
+static void tileSpan(float centre, float radius, int tiles, int& first, int& last) {
+	int start=firstPixel(centre-radius), end=lastPixel(centre+radius);
+	first=start<0?0:std::min(tiles, start/SoftwareRenderer::TILE_SIZE);
+	last=end<0?-1:std::min(tiles-1, end/SoftwareRenderer::TILE_SIZE);
+}
+
+// Counting sort of every (particle, tile) overlap by tile. Blocks are
+// contiguous runs of particles taken in order, so each bin keeps particle
+// order, the order FluidSimulation::Render draws in.
+void SoftwareRenderer::binParticles(unsigned int count, float radius, bool shaded) {
+	unsigned int numTiles=tilesX*tilesY;
+	unsigned int numBlocks=std::max(1u, std::min(GetNumThreads()*4, count/1024));
+	unsigned int blockSize=(count+numBlocks-1)/numBlocks;
+	blockTiles.assign((size_t)numBlocks*numTiles, 0);
+	parallel_for_blocks(numBlocks, [&](int block) {
+		unsigned int* tileCounts=&blockTiles[(size_t)block*numTiles];
+		unsigned int end=std::min(count, (block+1)*blockSize);
+		for (unsigned int i=block*blockSize; i<end; i++) {
+			int firstX, lastX, firstY, lastY;
+			tileSpan(screenX[i], radius, tilesX, firstX, lastX);
+			tileSpan(screenY[i], radius, tilesY, firstY, lastY);
+			for (int tileY=firstY; tileY<=lastY; tileY++)
+				for (int tileX=firstX; tileX<=lastX; tileX++)
+					tileCounts[tileY*tilesX+tileX]++;
+		}
+	});
+
+	unsigned int total=0;
+	for (unsigned int tile=0; tile<numTiles; tile++) {
+		tileStarts[tile]=total;
+		for (unsigned int block=0; block<numBlocks; block++) {
+			unsigned int& entry=blockTiles[(size_t)block*numTiles+tile];
+			unsigned int blockCount=entry;
+			entry=total;
+			total+=blockCount;
+		}
+	}
+	tileStarts[numTiles]=total;
+
+	binned.resize(total);
+	parallel_for_blocks(numBlocks, [&](int block) {
+		unsigned int* tileOffsets=&blockTiles[(size_t)block*numTiles];
+		unsigned int end=std::min(count, (block+1)*blockSize);
+		for (unsigned int i=block*blockSize; i<end; i++) {
+			int firstX, lastX, firstY, lastY;
+			tileSpan(screenX[i], radius, tilesX, firstX, lastX);
+			tileSpan(screenY[i], radius, tilesY, firstY, lastY);
+			const uint8_t* colour=shaded?palette[shades[i]]:SOLID_COLOUR;
+			BinnedParticle particle=(BinnedParticle){screenX[i], screenY[i], {colour[0], colour[1], colour[2], 0}};
+			for (int tileY=firstY; tileY<=lastY; tileY++)
+				for (int tileX=firstX; tileX<=lastX; tileX++)
+					binned[tileOffsets[tileY*tilesX+tileX]++]=particle;
+		}
+	});
+}
+
+// Clears one tile and fills every pixel of it whose centre lies inside one of
+// the discs binned to it.
+void SoftwareRenderer::drawTile(int tile, float radius) {
+	int x0=tile%tilesX*TILE_SIZE, y0=tile/tilesX*TILE_SIZE;
+	int x1=std::min(x0+TILE_SIZE, width), y1=std::min(y0+TILE_SIZE, height);
+	for (int row=y0; row<y1; row++)
+		std::memset(&pixels[((size_t)row*width+x0)*3], 0, (size_t)(x1-x0)*3);
+
+	float sqrRadius=radius*radius;
+	for (unsigned int e=tileStarts[tile]; e<tileStarts[tile+1]; e++) {
+		float cx=binned[e].x, cy=binned[e].y;
+		const uint8_t* colour=binned[e].colour;
+		int rowStart=std::max(y0, firstPixel(cy-radius));
+		int rowEnd=std::min(y1-1, lastPixel(cy+radius));
+		for (int row=rowStart; row<=rowEnd; row++) {
+			float dy=row+0.5f-cy;
+			float halfWidth=sqrtf(std::max(sqrRadius-dy*dy, 0.f));
+			int colStart=std::max(x0, firstPixel(cx-halfWidth));
+			int colEnd=std::min(x1-1, lastPixel(cx+halfWidth));
+			uint8_t* pixel=&pixels[((size_t)row*width+colStart)*3];
+			for (int col=colStart; col<=colEnd; col++, pixel+=3) {
+				pixel[0]=colour[0];
+				pixel[1]=colour[1];
+				pixel[2]=colour[2];
+			}
+		}
+	}
+}
+
+void SoftwareRenderer::Render(const ParticleData& particles, Vector2 boundsSize, float particleSize, float alpha,
+		ParticleColouring colouring, float colourRange) {
+	if (pixels.empty()) Resize(width, height);
+	float scale=std::min(width/boundsSize.x, height/boundsSize.y);
+	float radius=std::max(particleSize*scale, MIN_RADIUS);
+	project(particles, scale, alpha, colouring, colourRange);
+	binParticles(particles.Size(), radius, colouring!=ParticleColouring::Solid);
+	parallel_for_blocks(tilesX*tilesY, [&](int tile) {
+		drawTile(tile, radius);
+	});
+}
+
+bool SoftwareRenderer::WritePpm(const char* path, std::string* error) const {
+	FILE* file=fopen(path, "wb");
+	if (!file) return fail(error, std::string("cannot create ")+path);
+	bool ok=fprintf(file, "P6\n%d %d\n255\n", width, height)>0 &&
+		fwrite(pixels.data(), 1, pixels.size(), file)==pixels.size();
+	ok=fclose(file)==0 && ok;
+	return ok || fail(error, std::string("cannot write ")+path);
+}
+
+Y4mWriter::Y4mWriter() : file(nullptr), width(0), height(0) {}
+
+Y4mWriter::~Y4mWriter() {
+	Close();
+}
+
+bool Y4mWriter::Open(const char* path, int newWidth, int newHeight, unsigned int fps, std::string* error) {
+	Close();
+	file=fopen(path, "wb");
+	if (!file) return fail(error, std::string("cannot create ")+path);
+	width=newWidth;
+	height=newHeight;
+	planes.resize((size_t)width*height*3);
+	if (fprintf(file, "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C444\n", width, height, std::max(fps, 1u))<0) {
+		Close();
+		return fail(error, std::string("cannot write ")+path);
+	}
+	return true;
+}
+
+bool Y4mWriter::WriteFrame(const SoftwareRenderer& renderer) {
+	if (!file || renderer.Width()!=width || renderer.Height()!=height)
+		return false;
+	size_t planeSize=(size_t)width*height;
+	const uint8_t* rgb=renderer.Pixels();
+	uint8_t* luma=planes.data();
+	uint8_t* cb=luma+planeSize;
+	uint8_t* cr=cb+planeSize;
+	PARALLEL_FOR_BEGIN(height) {
+		for (size_t p=(size_t)i*width; p<(size_t)(i+1)*width; p++) {
+			int r=rgb[p*3], g=rgb[p*3+1], b=rgb[p*3+2];
+			luma[p]=(uint8_t)(((66*r+129*g+25*b+128)>>8)+16);
+			cb[p]=(uint8_t)(((-38*r-74*g+112*b+128)>>8)+128);
+			cr[p]=(uint8_t)(((112*r-94*g-18*b+128)>>8)+128);
+		}
+	}PARALLEL_FOR_END();
+	return fputs("FRAME\n", file)>=0 && fwrite(planes.data(), 1, planes.size(), file)==planes.size();
+}
+
+bool Y4mWriter::Close() {
+	if (!file) return true;
+	bool ok=fclose(file)==0;
+	file=nullptr;
+	return ok;
+}
+
+bool Y4mWriter::IsOpen() const {
+	return file!=nullptr;
+}
@@ -1,6 +1,16 @@
 #include "include/SpatialLookup.hpp"
 
-SpatialLookup::SpatialLookup() {
+static const int RADIX_BITS=11;
+static const unsigned int RADIX_BUCKETS=1u<<RADIX_BITS;
+static const unsigned int RADIX_MIN_BLOCK=4096;
+
+SpatialLookup::SpatialLookup() :
+	sortMode(SpatialSortMode::Radix), gridMode(SpatialGridMode::Hashed), numKeys(0), radius(1.f),
+	boundsOrigin((Vector2){0, 0}), boundsSize((Vector2){0, 0}), gridCols(1), gridRows(1),
+	pointsX(nullptr), pointsY(nullptr), timings(nullptr),
+	incremental(false), migrationThreshold(0.05f), keysValid(false),
+	keySpace((KeySpace){SpatialGridMode::Hashed, 0.f, (Vector2){0, 0}, 0, 0, 0}),
+	updateStats((SpatialUpdateStats){0, 0, 0, 0, 0}) {
 	cellOffsets = {
 		(CellCoord){-1,-1},
 		(CellCoord){-1,0},
@@ -16,66 +26,325 @@ SpatialLookup::SpatialLookup() {
 
 void SpatialLookup::Resize(int size) {
 	spatialLookup.resize(size);
-	startIndices.resize(size);
+	sortBuffer.resize(size);
+	Invalidate();
+}
+
+void SpatialLookup::SetSortMode(SpatialSortMode mode) {
+	sortMode=mode;
+}
+
+SpatialSortMode SpatialLookup::GetSortMode() const {
+	return sortMode;
+}
+
+void SpatialLookup::SetGridMode(SpatialGridMode mode) {
+	gridMode=mode;
+}
+
+SpatialGridMode SpatialLookup::GetGridMode() const {
+	return gridMode;
+}
+
+void SpatialLookup::SetBounds(Vector2 origin, Vector2 size) {
+	boundsOrigin=origin;
+	boundsSize=size;
+}
+
+void SpatialLookup::SetIncremental(bool enabled, float threshold) {
+	incremental=enabled;
+	migrationThreshold=threshold;
+}
+
+void SpatialLookup::Invalidate() {
+	keysValid=false;
+}
+
+unsigned int SpatialLookup::GetNumKeys() const {
+	return numKeys;
+}
+
+void SpatialLookup::SetPhaseTimings(PhaseTimings* phaseTimings) {
+	timings=phaseTimings;
+}
+
+SpatialQueryStats SpatialLookup::GetQueryStats() const {
+	SpatialQueryStats stats=(SpatialQueryStats){0, 0, 0};
+	for (const QueryCounter& counter : queryCounters) {
+		stats.queries+=counter.queries;
+		stats.visited+=counter.visited;
+		stats.accepted+=counter.accepted;
+	}
+	return stats;
+}
+
+void SpatialLookup::ResetQueryStats() {
+	queryCounters.assign(GetNumThreads(), QueryCounter());
+}
+
+SpatialUpdateStats SpatialLookup::GetUpdateStats() const {
+	return updateStats;
+}
+
+void SpatialLookup::ResetUpdateStats() {
+	updateStats=(SpatialUpdateStats){0, 0, 0, 0, 0};
+}
+
+const std::vector<SpatialLookupEntry>& SpatialLookup::GetEntries() const {
+	return spatialLookup;
 }
 
 bool compareByCellKey(const SpatialLookupEntry& a, const SpatialLookupEntry& b) {
 	return a.cellKey < b.cellKey;
 }
 
-void SpatialLookup::UpdateSpatialLookup(std::vector<Vector2> newPoints, float newRadius) {
-	points=newPoints;
+static bool compareByCellKeyThenIndex(const SpatialLookupEntry& a, const SpatialLookupEntry& b) {
+	return a.cellKey<b.cellKey || (a.cellKey==b.cellKey && a.particleIndex<b.particleIndex);
+}
+
+void SpatialLookup::UpdateSpatialLookup(const float* newPointsX, const float* newPointsY, float newRadius) {
+	pointsX=newPointsX;
+	pointsY=newPointsY;
 	radius=newRadius;
-	PARALLEL_FOR_BEGIN(points.size()) {
-		spatialLookup[i]=(SpatialLookupEntry){
-			i, getKeyFromHash(hashCell(positionToCellCoord(points[i])))
-		};
-		startIndices[i]=INT_MAX;
-	}PARALLEL_FOR_END();
-	std::sort(spatialLookup.begin(), spatialLookup.end(), compareByCellKey);
-	PARALLEL_FOR_BEGIN(points.size()) {
-		unsigned int key=spatialLookup[i].cellKey;
-		unsigned int keyPrev=i==0?2*INT_MAX:spatialLookup[i-1].cellKey;
-		if (key!=keyPrev) {
-			startIndices[key]=i;
+	if (gridMode==SpatialGridMode::Dense) {
+		gridCols=std::max(1, (int)ceilf(boundsSize.x/radius));
+		gridRows=std::max(1, (int)ceilf(boundsSize.y/radius));
+		numKeys=gridCols*gridRows;
+	} else {
+		numKeys=spatialLookup.size();
+	}
+	cellStarts.resize(numKeys+1);
+	if (queryCounters.size()!=GetNumThreads())
+		ResetQueryStats();
+
+	KeySpace newKeySpace=(KeySpace){gridMode, radius, boundsOrigin, gridCols, gridRows, numKeys};
+	bool repairable=incremental && keysValid &&
+		newKeySpace.mode==keySpace.mode && newKeySpace.radius==keySpace.radius &&
+		newKeySpace.numKeys==keySpace.numKeys &&
+		(gridMode==SpatialGridMode::Hashed || (
+			newKeySpace.origin.x==keySpace.origin.x && newKeySpace.origin.y==keySpace.origin.y &&
+			newKeySpace.cols==keySpace.cols && newKeySpace.rows==keySpace.rows));
+	keySpace=newKeySpace;
+	keysValid=incremental;
+
+	unsigned int numEntries=spatialLookup.size();
+	{
+		SPH_PHASE_TIMER(timings, SimulationPhase::GridHash);
+		if (incremental) {
+			pointKeys.swap(previousKeys);
+			pointKeys.resize(numEntries);
+			PARALLEL_FOR_BEGIN(numEntries) {
+				pointKeys[i]=cellKey(positionToCellCoord((Vector2){pointsX[i], pointsY[i]}));
+			}PARALLEL_FOR_END();
+		} else {
+			PARALLEL_FOR_BEGIN(numEntries) {
+				spatialLookup[i]=(SpatialLookupEntry){
+					i, cellKey(positionToCellCoord((Vector2){pointsX[i], pointsY[i]}))
+				};
+			}PARALLEL_FOR_END();
 		}
+	}
+	if (!repairable || !repairEntries()) {
+		SPH_PHASE_TIMER(timings, SimulationPhase::GridSort);
+		if (incremental) {
+			PARALLEL_FOR_BEGIN(numEntries) {
+				spatialLookup[i]=(SpatialLookupEntry){i, pointKeys[i]};
+			}PARALLEL_FOR_END();
+		}
+		sortEntries();
+		updateStats.rebuilds++;
+	}
+	// Each entry that opens a run of its key also starts every empty key
+	// between the previous run and its own, so all of the table is written.
+	SPH_PHASE_TIMER(timings, SimulationPhase::GridStarts);
+	PARALLEL_FOR_BEGIN(numEntries) {
+		unsigned int key=spatialLookup[i].cellKey;
+		unsigned int firstKey=i==0?0:spatialLookup[i-1].cellKey+1;
+		for (unsigned int k=firstKey; k<=key; k++)
+			cellStarts[k]=i;
 	}PARALLEL_FOR_END();
+	unsigned int firstKey=numEntries==0?0:spatialLookup[numEntries-1].cellKey+1;
+	std::fill(cellStarts.begin()+firstKey, cellStarts.end(), (int)numEntries);
+}
+
+// Entries whose point kept its key are still in order. The migrated points,
+// gathered in index order, are radix sorted by key and merged back in. The
+// full rebuild also sorts index-ordered entries stably, so both paths order
+// by key then index and give the same result. Returns false, leaving the
+// entries untouched, when too many keys changed for the merge to pay off.
+bool SpatialLookup::repairEntries() {
+	SPH_PHASE_TIMER(timings, SimulationPhase::GridRepair);
+	unsigned int numEntries=spatialLookup.size();
+	unsigned int numMigrated=parallel_reduce(numEntries, 0u, [&](int start, int end) {
+		unsigned int partial=0;
+		for (int i=start; i<end; i++)
+			partial+=pointKeys[i]!=previousKeys[i];
+		return partial;
+	}, [](unsigned int a, unsigned int b) { return a+b; });
+	updateStats.checked+=numEntries;
+	updateStats.migrated+=numMigrated;
+	if (numMigrated>migrationThreshold*numEntries) {
+		updateStats.fallbacks++;
+		return false;
+	}
+	updateStats.repairs++;
+	if (numMigrated==0) return true;
+
+	migrants.resize(numMigrated);
+	for (unsigned int i=0, m=0; i<numEntries; i++) {
+		if (pointKeys[i]!=previousKeys[i])
+			migrants[m++]=(SpatialLookupEntry){(int)i, pointKeys[i]};
+	}
+	RadixSortEntries(migrants, migrantsBuffer, histograms, numKeys-1);
+
+	// One pass drops the migrated entries and merges the sorted migrants in.
+	unsigned int m=0, k=0;
+	for (const SpatialLookupEntry& entry : spatialLookup) {
+		if (pointKeys[entry.particleIndex]!=entry.cellKey) continue;
+		while (m<numMigrated && compareByCellKeyThenIndex(migrants[m], entry))
+			sortBuffer[k++]=migrants[m++];
+		sortBuffer[k++]=entry;
+	}
+	while (m<numMigrated)
+		sortBuffer[k++]=migrants[m++];
+	spatialLookup.swap(sortBuffer);
+	return true;
+}
+
+void SpatialLookup::sortEntries() {
+	if (sortMode==SpatialSortMode::Radix) {
+		if (spatialLookup.size()>=2)
+			RadixSortEntries(spatialLookup, sortBuffer, histograms, numKeys-1);
+	} else {
+		std::sort(spatialLookup.begin(), spatialLookup.end(), compareByCellKey);
+	}
+}
+
+// Each pass is stable: blocks histogram their contiguous slice, a serial
+// prefix sum turns the histograms into per-block write offsets, and every
+// block scatters its slice in order.
+void RadixSortEntries(std::vector<SpatialLookupEntry>& entries,
+		std::vector<SpatialLookupEntry>& scratch,
+		std::vector<unsigned int>& histograms, unsigned int maxKey) {
+	unsigned int n=entries.size();
+	if (n<2) return;
+	scratch.resize(n);
+	int keyBits=0;
+	while (keyBits<32 && (maxKey>>keyBits)!=0) keyBits++;
+
+	unsigned int numBlocks=std::max(1u, std::min(GetNumThreads(), n/RADIX_MIN_BLOCK));
+	unsigned int blockSize=(n+numBlocks-1)/numBlocks;
+	histograms.resize((size_t)numBlocks*RADIX_BUCKETS);
+
+	for (int shift=0; shift<keyBits; shift+=RADIX_BITS) {
+		std::fill(histograms.begin(), histograms.end(), 0);
+		parallel_for_blocks(numBlocks, [&](int block) {
+			unsigned int* hist=&histograms[(size_t)block*RADIX_BUCKETS];
+			unsigned int end=std::min(n, (block+1)*blockSize);
+			for (unsigned int i=block*blockSize; i<end; i++)
+				hist[(entries[i].cellKey>>shift)&(RADIX_BUCKETS-1)]++;
+		});
+
+		unsigned int offset=0;
+		for (unsigned int digit=0; digit<RADIX_BUCKETS; digit++) {
+			for (unsigned int block=0; block<numBlocks; block++) {
+				unsigned int& count=histograms[(size_t)block*RADIX_BUCKETS+digit];
+				unsigned int blockCount=count;
+				count=offset;
+				offset+=blockCount;
+			}
+		}
+
+		parallel_for_blocks(numBlocks, [&](int block) {
+			unsigned int* dst=&histograms[(size_t)block*RADIX_BUCKETS];
+			unsigned int end=std::min(n, (block+1)*blockSize);
+			for (unsigned int i=block*blockSize; i<end; i++) {
+				const SpatialLookupEntry& entry=entries[i];
+				scratch[dst[(entry.cellKey>>shift)&(RADIX_BUCKETS-1)]++]=entry;
+			}
+		});
+		entries.swap(scratch);
+	}
 }
 
 std::vector<int> SpatialLookup::GetPointsWithinRadius(Vector2 point) {
-	CellCoord coord=positionToCellCoord(point);
-	float sqrSmoothingRadius=radius*radius;
 	std::vector<int> pointsWithinRadius;
+	ForEachNeighbour(point, [&](int particleIdx, Vector2, float) {
+		pointsWithinRadius.push_back(particleIdx);
+	});
+	return pointsWithinRadius;
+}
 
-	for (CellCoord offset : cellOffsets) {
-		unsigned int key=getKeyFromHash(hashCell((CellCoord){
+// Index ranges of the candidates around point. Hashed: the 3x3 cells' keys,
+// with duplicates from neighbouring cells hashing alike dropped so each bucket
+// is scanned once. Dense: the three cells of each row are consecutive keys, so
+// every row is a single range.
+int SpatialLookup::stencilSpans(Vector2 point, int spans[9][2]) const {
+	CellCoord coord=positionToCellCoord(point);
+	int numSpans=0;
+	if (gridMode==SpatialGridMode::Dense) {
+		int firstCol=std::max(coord.x-1, 0);
+		int lastCol=std::min(coord.x+1, gridCols-1);
+		for (int row=std::max(coord.y-1, 0); row<=std::min(coord.y+1, gridRows-1); row++) {
+			int begin=cellStarts[row*gridCols+firstCol];
+			int end=cellStarts[row*gridCols+lastCol+1];
+			if (begin<end) {
+				spans[numSpans][0]=begin;
+				spans[numSpans][1]=end;
+				numSpans++;
+			}
+		}
+		return numSpans;
+	}
+
+	unsigned int keys[9];
+	int numKeys=0;
+	for (const CellCoord& offset : cellOffsets) {
+		unsigned int key=cellKey((CellCoord){
 			offset.x+coord.x,
 			offset.y+coord.y
-		}));
-		for (int i=startIndices[key]; i<spatialLookup.size(); i++) {
-			if (spatialLookup[i].cellKey!=key) break;
-			int particleIdx=spatialLookup[i].particleIndex;
-			float sqrDist=Vector2DistanceSqr(points[particleIdx],point);
-			if (sqrDist<sqrSmoothingRadius)
-				pointsWithinRadius.push_back(particleIdx);
+		});
+		if (std::find(keys, keys+numKeys, key)!=keys+numKeys) continue;
+		keys[numKeys++]=key;
+		if (cellStarts[key]<cellStarts[key+1]) {
+			spans[numSpans][0]=cellStarts[key];
+			spans[numSpans][1]=cellStarts[key+1];
+			numSpans++;
 		}
 	}
-	return pointsWithinRadius;
+	return numSpans;
 }
 
-CellCoord SpatialLookup::positionToCellCoord(Vector2 position) {
+// Floor, so every cell is radius wide including those either side of zero.
+// Dense coordinates clamp to the grid; clamping never moves two points
+// further apart, so neighbours still land in adjacent cells.
+CellCoord SpatialLookup::positionToCellCoord(Vector2 position) const {
+	if (gridMode==SpatialGridMode::Dense) {
+		int x=(int)floorf((position.x-boundsOrigin.x)/radius);
+		int y=(int)floorf((position.y-boundsOrigin.y)/radius);
+		return (CellCoord){
+			std::min(std::max(x, 0), gridCols-1),
+			std::min(std::max(y, 0), gridRows-1)
+		};
+	}
 	return (CellCoord){
-		(int)(position.x/radius),
-		(int)(position.y/radius)
+		(int)floorf(position.x/radius),
+		(int)floorf(position.y/radius)
 	};
 }
 
-unsigned int SpatialLookup::hashCell(CellCoord cell) {
+unsigned int SpatialLookup::hashCell(CellCoord cell) const {
 	unsigned int a = (unsigned int)cell.x*15823;
 	unsigned int b = (unsigned int)cell.y*9737333;
 	return a+b;
 }
 
-unsigned int SpatialLookup::getKeyFromHash(unsigned int hash) {
+unsigned int SpatialLookup::getKeyFromHash(unsigned int hash) const {
 	return hash%(unsigned int)(spatialLookup.size());
 }
+
+unsigned int SpatialLookup::cellKey(CellCoord cell) const {
+	if (gridMode==SpatialGridMode::Dense)
+		return cell.y*gridCols+cell.x;
+	return getKeyFromHash(hashCell(cell));
+}
@@ -0,0 +1,310 @@
+#include "include/TrajectoryCodec.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const size_t LZ_MIN_MATCH=4;
+static const size_t LZ_MAX_OFFSET=65535;
+// Inputs end in at least this many literals, so a match never runs to the
+// very end of the buffer.
+static const size_t LZ_LAST_LITERALS=5;
+static const int LZ_HASH_BITS=14;
+
+static uint32_t read32(const uint8_t* p) {
+	uint32_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint32_t lzHash(uint32_t sequence) {
+	return (sequence*2654435761u)>>(32-LZ_HASH_BITS);
+}
+
+static uint8_t* writeLength(uint8_t* op, size_t length) {
+	for (; length>=255; length-=255)
+		*op++=255;
+	*op++=(uint8_t)length;
+	return op;
+}
+
+// One token: literal count in the high nibble, match length minus
+// LZ_MIN_MATCH in the low nibble, 15 meaning more length bytes follow.
+static uint8_t* writeSequence(uint8_t* op, const uint8_t* literals, size_t numLiterals, size_t offset, size_t matchLength) {
+	uint8_t* token=op++;
+	size_t matchCode=matchLength-LZ_MIN_MATCH;
+	*token=(uint8_t)((std::min(numLiterals, (size_t)15)<<4)|(offset?std::min(matchCode, (size_t)15):0));
+	if (numLiterals>=15) op=writeLength(op, numLiterals-15);
+	std::memcpy(op, literals, numLiterals);
+	op+=numLiterals;
+	if (!offset) return op;
+	*op++=(uint8_t)offset;
+	*op++=(uint8_t)(offset>>8);
+	if (matchCode>=15) op=writeLength(op, matchCode-15);
+	return op;
+}
+
+size_t LzCompressBound(size_t bytes) {
+	return bytes+bytes/255+16;
+}
+
+// A match of 3+k bytes, token, offset and k length bytes, copies at most
+// 19+255k; literals copy one byte per byte read.
+uint64_t LzDecompressBound(uint64_t bytes) {
+	return bytes*255;
+}
+
+// Greedy parse with a single-entry hash table. Misses advance faster the
+// longer they run, so incompressible stretches cost little.
+size_t LzCompress(const uint8_t* src, size_t bytes, uint8_t* dst) {
+	uint8_t* op=dst;
+	size_t anchor=0;
+	if (bytes>LZ_MIN_MATCH+LZ_LAST_LITERALS) {
+		std::vector<uint32_t> table((size_t)1<<LZ_HASH_BITS, 0);
+		size_t limit=bytes-LZ_MIN_MATCH-LZ_LAST_LITERALS;
+		size_t ip=1;
+		size_t misses=0;
+		while (ip<limit) {
+			uint32_t sequence=read32(src+ip);
+			uint32_t& slot=table[lzHash(sequence)];
+			size_t candidate=slot;
+			slot=(uint32_t)ip;
+			if (ip-candidate>LZ_MAX_OFFSET || read32(src+candidate)!=sequence) {
+				ip+=1+(misses++>>5);
+				continue;
+			}
+			misses=0;
+			size_t length=LZ_MIN_MATCH;
+			while (ip+length<bytes-LZ_LAST_LITERALS && src[candidate+length]==src[ip+length])
+				length++;
+			op=writeSequence(op, src+anchor, ip-anchor, ip-candidate, length);
+			ip+=length;
+			anchor=ip;
+		}
+	}
+	op=writeSequence(op, src+anchor, bytes-anchor, 0, LZ_MIN_MATCH);
+	return op-dst;
+}
+
+static bool readLength(const uint8_t*& ip, const uint8_t* end, size_t& length) {
+	uint8_t byte;
+	do {
+		if (ip>=end) return false;
+		byte=*ip++;
+		length+=byte;
+	} while (byte==255);
+	return true;
+}
+
+bool LzDecompress(const uint8_t* src, size_t srcBytes, uint8_t* dst, size_t dstBytes) {
+	const uint8_t* ip=src;
+	const uint8_t* end=src+srcBytes;
+	size_t op=0;
+	while (ip<end) {
+		uint8_t token=*ip++;
+		size_t numLiterals=token>>4;
+		if (numLiterals==15 && !readLength(ip, end, numLiterals)) return false;
+		if (numLiterals>(size_t)(end-ip) || numLiterals>dstBytes-op) return false;
+		std::memcpy(dst+op, ip, numLiterals);
+		ip+=numLiterals;
+		op+=numLiterals;
+		if (ip==end) break;
+
+		if (end-ip<2) return false;
+		size_t offset=ip[0]|(ip[1]<<8);
+		ip+=2;
+		size_t length=token&15;
+		if (length==15 && !readLength(ip, end, length)) return false;
+		length+=LZ_MIN_MATCH;
+		if (offset==0 || offset>op || length>dstBytes-op) return false;
+		// Byte by byte: the source may overlap what is being written.
+		for (size_t k=0; k<length; k++, op++)
+			dst[op]=dst[op-offset];
+	}
+	return op==dstBytes;
+}
+
+void ShuffleBytes(const uint16_t* values, size_t count, uint8_t* dst) {
+	for (size_t i=0; i<count; i++) {
+		dst[i]=(uint8_t)values[i];
+		dst[count+i]=(uint8_t)(values[i]>>8);
+	}
+}
+
+void UnshuffleBytes(const uint8_t* src, size_t count, uint16_t* values) {
+	for (size_t i=0; i<count; i++)
+		values[i]=(uint16_t)(src[i]|(src[count+i]<<8));
+}
+
+// Small deltas of either sign map to small unsigned values, so their high
+// bytes are zero.
+static uint16_t zigzag(uint16_t delta) {
+	int16_t value=(int16_t)delta;
+	return (uint16_t)((value<<1)^(value>>15));
+}
+
+static uint16_t unzigzag(uint16_t code) {
+	return (uint16_t)((code>>1)^(0-(code&1)));
+}
+
+static const float QUANTIZED_MAX=65535.f;
+// Velocity range of a keyframe over its largest speed, so frames after it
+// can speed up a little before forcing the next keyframe.
+static const float VELOCITY_HEADROOM=1.25f;
+static const float MIN_STEP=1e-6f;
+// Decoded velocities reach 32768 steps from zero, where one float ulp is at
+// most step/256.
+static const float VELOCITY_ROUNDING=1.f/256;
+
+QuantizedEncoder::QuantizedEncoder() : count(0), positionError(0), velocityError(0), framesSinceKey(0), haveKey(false) {
+	std::memset(&settings, 0, sizeof(settings));
+	std::memset(&key, 0, sizeof(key));
+}
+
+void QuantizedEncoder::Reset(unsigned int newCount, const QuantizationSettings& newSettings) {
+	count=newCount;
+	settings=newSettings;
+	settings.keyframeInterval=std::max(1u, settings.keyframeInterval);
+	keyValues.assign((size_t)count*4, 0);
+	values.assign((size_t)count*4, 0);
+	shuffled.assign((size_t)count*8, 0);
+	framesSinceKey=0;
+	haveKey=false;
+}
+
+// Step for one position axis. A decoded value is rounded to float, which
+// adds up to an ulp at the largest coordinate it can take, so the step is
+// shrunk to keep the sum within tolerance; rounding returns that ulp.
+static float positionStep(float origin, float size, float tolerance, float& rounding) {
+	float finest=size/QUANTIZED_MAX;
+	float largest=std::max(fabsf(origin), fabsf(origin+size))+std::max(std::max(2*tolerance, finest), MIN_STEP);
+	rounding=nextafterf(largest, INFINITY)-largest;
+	return std::max(std::max(2*(tolerance-rounding), finest), MIN_STEP);
+}
+
+void QuantizedEncoder::startKeyframe(uint64_t frame, const float* vx, const float* vy) {
+	float maxSpeed=0;
+	for (unsigned int i=0; i<count; i++)
+		maxSpeed=std::max(maxSpeed, std::max(fabsf(vx[i]), fabsf(vy[i])));
+	float range=maxSpeed*VELOCITY_HEADROOM;
+	std::memset(&key, 0, sizeof(key));
+	key.keyframe=frame;
+	key.positionOrigin[0]=settings.boundsOrigin.x;
+	key.positionOrigin[1]=settings.boundsOrigin.y;
+	float roundingX, roundingY;
+	key.positionStep[0]=positionStep(settings.boundsOrigin.x, settings.boundsSize.x, settings.positionTolerance, roundingX);
+	key.positionStep[1]=positionStep(settings.boundsOrigin.y, settings.boundsSize.y, settings.positionTolerance, roundingY);
+	key.velocityStep=std::max(std::max(2*settings.velocityTolerance/(1+2*VELOCITY_ROUNDING), 2*range/QUANTIZED_MAX), MIN_STEP);
+	key.velocityOrigin=-32768*key.velocityStep;
+	positionError=std::max(0.5f*key.positionStep[0]+roundingX, 0.5f*key.positionStep[1]+roundingY);
+	velocityError=(0.5f+VELOCITY_ROUNDING)*key.velocityStep;
+}
+
+// Positions outside the box clamp to its edge. Returns false when a velocity
+// falls outside the keyframe's range.
+bool QuantizedEncoder::quantize(const float* x, const float* y, const float* vx, const float* vy) {
+	// Double precision: the box origin is large enough that float rounding
+	// alone would push the error past half a step.
+	double inverseX=1.0/key.positionStep[0], inverseY=1.0/key.positionStep[1];
+	double inverseV=1.0/key.velocityStep;
+	uint16_t* qx=values.data();
+	uint16_t* qy=qx+count;
+	uint16_t* qvx=qy+count;
+	uint16_t* qvy=qvx+count;
+	bool inRange=true;
+	for (unsigned int i=0; i<count; i++) {
+		float px=(float)rint((x[i]-(double)key.positionOrigin[0])*inverseX);
+		float py=(float)rint((y[i]-(double)key.positionOrigin[1])*inverseY);
+		float pvx=(float)rint((vx[i]-(double)key.velocityOrigin)*inverseV);
+		float pvy=(float)rint((vy[i]-(double)key.velocityOrigin)*inverseV);
+		inRange&=pvx>=0 && pvx<=QUANTIZED_MAX && pvy>=0 && pvy<=QUANTIZED_MAX;
+		qx[i]=(uint16_t)std::min(std::max(px, 0.f), QUANTIZED_MAX);
+		qy[i]=(uint16_t)std::min(std::max(py, 0.f), QUANTIZED_MAX);
+		qvx[i]=(uint16_t)std::min(std::max(pvx, 0.f), QUANTIZED_MAX);
+		qvy[i]=(uint16_t)std::min(std::max(pvy, 0.f), QUANTIZED_MAX);
+	}
+	return inRange;
+}
+
+bool QuantizedEncoder::Encode(uint64_t frame, const float* x, const float* y, const float* vx, const float* vy,
+		std::vector<uint8_t>& payload) {
+	bool isKey=!haveKey || framesSinceKey>=settings.keyframeInterval ||
+		!quantize(x, y, vx, vy);
+	size_t numValues=(size_t)count*4;
+	if (isKey) {
+		startKeyframe(frame, vx, vy);
+		quantize(x, y, vx, vy);
+		keyValues=values;
+		framesSinceKey=0;
+		haveKey=true;
+	} else {
+		for (size_t i=0; i<numValues; i++)
+			values[i]=zigzag((uint16_t)(values[i]-keyValues[i]));
+	}
+	framesSinceKey++;
+
+	ShuffleBytes(values.data(), numValues, shuffled.data());
+	QuantizedFrameInfo info=key;
+	payload.resize(sizeof(info)+LzCompressBound(shuffled.size()));
+	info.compressedBytes=(uint32_t)LzCompress(shuffled.data(), shuffled.size(), payload.data()+sizeof(info));
+	std::memcpy(payload.data(), &info, sizeof(info));
+	payload.resize(sizeof(info)+info.compressedBytes);
+	return isKey;
+}
+
+float QuantizedEncoder::PositionError() const {
+	return positionError;
+}
+
+float QuantizedEncoder::VelocityError() const {
+	return velocityError;
+}
+
+QuantizedDecoder::QuantizedDecoder() : count(0), keyframe(0), haveKey(false) {}
+
+void QuantizedDecoder::Reset(unsigned int newCount) {
+	count=newCount;
+	keyValues.assign((size_t)count*4, 0);
+	values.assign((size_t)count*4, 0);
+	shuffled.assign((size_t)count*8, 0);
+	haveKey=false;
+}
+
+uint64_t QuantizedDecoder::KeyframeOf(const uint8_t* payload) {
+	QuantizedFrameInfo info;
+	std::memcpy(&info, payload, sizeof(info));
+	return info.keyframe;
+}
+
+bool QuantizedDecoder::Decode(uint64_t frame, const uint8_t* payload, size_t bytes,
+		float* x, float* y, float* vx, float* vy) {
+	if (bytes<sizeof(QuantizedFrameInfo)) return false;
+	QuantizedFrameInfo info;
+	std::memcpy(&info, payload, sizeof(info));
+	bool isKey=info.keyframe==frame;
+	if (!isKey && (!haveKey || info.keyframe!=keyframe)) return false;
+	if (info.compressedBytes>bytes-sizeof(info) ||
+		!LzDecompress(payload+sizeof(info), info.compressedBytes, shuffled.data(), shuffled.size()))
+		return false;
+	size_t numValues=(size_t)count*4;
+	UnshuffleBytes(shuffled.data(), numValues, values.data());
+	if (isKey) {
+		keyValues=values;
+		keyframe=frame;
+		haveKey=true;
+	} else {
+		for (size_t i=0; i<numValues; i++)
+			values[i]=(uint16_t)(keyValues[i]+unzigzag(values[i]));
+	}
+
+	const uint16_t* qx=values.data();
+	const uint16_t* qy=qx+count;
+	const uint16_t* qvx=qy+count;
+	const uint16_t* qvy=qvx+count;
+	for (unsigned int i=0; i<count; i++) {
+		x[i]=(float)(info.positionOrigin[0]+qx[i]*(double)info.positionStep[0]);
+		y[i]=(float)(info.positionOrigin[1]+qy[i]*(double)info.positionStep[1]);
+		vx[i]=(float)(info.velocityOrigin+qvx[i]*(double)info.velocityStep);
+		vy[i]=(float)(info.velocityOrigin+qvy[i]*(double)info.velocityStep);
+	}
+	return true;
+}
@@ -0,0 +1,198 @@
+#include "include/TrajectoryReader.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool fail(std::string* error, const std::string& message) {
+	if (error) *error=message;
+	return false;
+}
+
+static uint64_t alignUp(uint64_t bytes) {
+	return (bytes+TRAJECTORY_ALIGNMENT-1)/TRAJECTORY_ALIGNMENT*TRAJECTORY_ALIGNMENT;
+}
+
+// Whether one frame of count particles could fit in a file of this size, so
+// a corrupt count is rejected before buffers are sized by it. Strides only
+// pad count to a multiple of 16.
+static bool countFits(const TrajectoryHeader& header, uint64_t bytes) {
+	if (header.stride<header.count || header.stride-header.count>=16 || header.stride%16!=0) return false;
+	uint64_t overhead=sizeof(TrajectoryHeader)+sizeof(TrajectoryFrameHeader);
+	uint64_t payloadBytes=bytes>overhead?bytes-overhead:0;
+	if (header.encoding==(uint32_t)TrajectoryEncoding::Raw)
+		return (uint64_t)header.stride*4*sizeof(float)<=payloadBytes;
+	return payloadBytes>=sizeof(QuantizedFrameInfo) &&
+		(uint64_t)header.count*4*sizeof(uint16_t)<=LzDecompressBound(payloadBytes-sizeof(QuantizedFrameInfo));
+}
+
+TrajectoryReader::TrajectoryReader() :
+	base(nullptr), bytes(0), index(nullptr), numFrames(0), decodedKeyframe(0) {
+	std::memset(&header, 0, sizeof(header));
+}
+
+TrajectoryReader::~TrajectoryReader() {
+	Close();
+}
+
+bool TrajectoryReader::Open(const char* path, std::string* error) {
+	Close();
+	int fd=open(path, O_RDONLY);
+	if (fd<0) return fail(error, std::string("cannot open ")+path);
+	struct stat info;
+	if (fstat(fd, &info)!=0 || (size_t)info.st_size<sizeof(TrajectoryHeader)) {
+		close(fd);
+		return fail(error, std::string(path)+" is not a trajectory");
+	}
+	void* mapped=mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped==MAP_FAILED) return fail(error, std::string("cannot map ")+path);
+	base=(const uint8_t*)mapped;
+	bytes=info.st_size;
+
+	std::memcpy(&header, base, sizeof(header));
+	std::string problem;
+	if (std::memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic))!=0)
+		problem="is not a trajectory";
+	else if (header.version!=TRAJECTORY_VERSION)
+		problem="has version "+std::to_string(header.version)+", expected "+std::to_string(TRAJECTORY_VERSION);
+	else if (header.headerBytes!=sizeof(TrajectoryHeader) ||
+		header.encoding>(uint32_t)TrajectoryEncoding::Quantized16)
+		problem="has an invalid header";
+	else if (header.indexOffset==0) {
+		if (!recoverIndex()) problem="has no frames";
+	} else if (header.indexOffset%alignof(TrajectoryIndexEntry)!=0 || header.indexOffset>bytes ||
+		header.numFrames>(bytes-header.indexOffset)/sizeof(TrajectoryIndexEntry))
+		problem="is truncated";
+	else if (header.numFrames==0)
+		problem="has no frames";
+	else {
+		index=(const TrajectoryIndexEntry*)(base+header.indexOffset);
+		numFrames=header.numFrames;
+	}
+	// Checked once a file is known to have frames, so an empty one still
+	// reports that.
+	if (problem.empty() && !countFits(header, bytes))
+		problem="has an invalid header";
+	if (!problem.empty()) {
+		Close();
+		return fail(error, std::string(path)+" "+problem);
+	}
+	if (header.encoding==(uint32_t)TrajectoryEncoding::Quantized16)
+		decoder.Reset(header.count);
+	decodedKeyframe=numFrames;
+	return true;
+}
+
+// Rebuilds the index of a file whose recorder never closed by walking the
+// frame headers, stopping at the first one that is missing or cut short.
+bool TrajectoryReader::recoverIndex() {
+	recoveredIndex.clear();
+	uint64_t offset=sizeof(TrajectoryHeader);
+	while (offset+sizeof(TrajectoryFrameHeader)<=bytes) {
+		const TrajectoryFrameHeader* frame=(const TrajectoryFrameHeader*)(base+offset);
+		uint64_t payloadOffset=offset+sizeof(TrajectoryFrameHeader);
+		if (frame->magic!=TRAJECTORY_FRAME_MAGIC || frame->frame!=recoveredIndex.size() ||
+			frame->payloadBytes>bytes-payloadOffset)
+			break;
+		recoveredIndex.push_back((TrajectoryIndexEntry){offset, frame->step, frame->time});
+		offset=alignUp(payloadOffset+frame->payloadBytes);
+	}
+	index=recoveredIndex.data();
+	numFrames=recoveredIndex.size();
+	return numFrames>0;
+}
+
+void TrajectoryReader::Close() {
+	if (base) munmap((void*)base, bytes);
+	base=nullptr;
+	bytes=0;
+	index=nullptr;
+	numFrames=0;
+	recoveredIndex.clear();
+}
+
+bool TrajectoryReader::IsOpen() const {
+	return base!=nullptr;
+}
+
+unsigned int TrajectoryReader::Count() const {
+	return header.count;
+}
+
+unsigned int TrajectoryReader::Interval() const {
+	return header.interval;
+}
+
+uint64_t TrajectoryReader::NumFrames() const {
+	return numFrames;
+}
+
+const TrajectoryIndexEntry& TrajectoryReader::Frame(uint64_t frame) const {
+	return index[frame];
+}
+
+uint64_t TrajectoryReader::FindFrame(double time) const {
+	const TrajectoryIndexEntry* after=std::upper_bound(index, index+numFrames, time,
+		[](double t, const TrajectoryIndexEntry& entry) { return t<entry.time; });
+	return after==index?0:after-index-1;
+}
+
+// Null if the index entry does not lead to a whole frame.
+const TrajectoryFrameHeader* TrajectoryReader::frameHeader(uint64_t frame) const {
+	uint64_t offset=index[frame].offset;
+	if (offset%TRAJECTORY_ALIGNMENT!=0 || offset>bytes || bytes-offset<sizeof(TrajectoryFrameHeader))
+		return nullptr;
+	const TrajectoryFrameHeader* frameHeader=(const TrajectoryFrameHeader*)(base+offset);
+	if (frameHeader->magic!=TRAJECTORY_FRAME_MAGIC || frameHeader->frame!=frame ||
+		frameHeader->encoding!=header.encoding ||
+		frameHeader->payloadBytes>bytes-offset-sizeof(TrajectoryFrameHeader))
+		return nullptr;
+	return frameHeader;
+}
+
+bool TrajectoryReader::decode(uint64_t frame, float* x, float* y, float* vx, float* vy) {
+	const TrajectoryFrameHeader* frameHeader=this->frameHeader(frame);
+	if (!frameHeader) return false;
+	const uint8_t* payload=(const uint8_t*)(frameHeader+1);
+	if (header.encoding==(uint32_t)TrajectoryEncoding::Raw) {
+		if (frameHeader->payloadBytes<(uint64_t)header.stride*4*sizeof(float)) return false;
+		const float* data=(const float*)payload;
+		std::copy(data, data+header.count, x);
+		std::copy(data+header.stride, data+header.stride+header.count, y);
+		std::copy(data+2*header.stride, data+2*header.stride+header.count, vx);
+		std::copy(data+3*header.stride, data+3*header.stride+header.count, vy);
+		return true;
+	}
+
+	if (frameHeader->payloadBytes<sizeof(QuantizedFrameInfo)) return false;
+	uint64_t keyframe=QuantizedDecoder::KeyframeOf(payload);
+	if (keyframe>frame) return false;
+	if (keyframe!=frame && keyframe!=decodedKeyframe && !decode(keyframe, x, y, vx, vy))
+		return false;
+	if (!decoder.Decode(frame, payload, frameHeader->payloadBytes, x, y, vx, vy))
+		return false;
+	if (keyframe==frame) decodedKeyframe=frame;
+	return true;
+}
+
+// Asks the kernel to start reading a frame's pages so they are resident by
+// the time playback reaches it.
+void TrajectoryReader::prefetch(uint64_t frame) const {
+	if (frame>=numFrames) return;
+	uint64_t start=index[frame].offset;
+	uint64_t end=frame+1<numFrames?index[frame+1].offset:bytes;
+	if (start>=end || end>bytes) return;
+	uint64_t pageSize=sysconf(_SC_PAGESIZE);
+	uint64_t pageStart=start/pageSize*pageSize;
+	madvise((void*)(base+pageStart), end-pageStart, MADV_WILLNEED);
+}
+
+bool TrajectoryReader::ReadFrame(uint64_t frame, float* x, float* y, float* vx, float* vy) {
+	if (!base || frame>=numFrames || !decode(frame, x, y, vx, vy))
+		return false;
+	prefetch(frame+1);
+	return true;
+}
@@ -0,0 +1,222 @@
+#include "include/TrajectoryRecorder.hpp"
+#include "include/parallel.hpp"
+#include <chrono>
+#include <cstring>
+
+static_assert(sizeof(TrajectoryHeader)%TRAJECTORY_ALIGNMENT==0, "frames must start aligned");
+static_assert(sizeof(TrajectoryFrameHeader)==TRAJECTORY_ALIGNMENT, "payloads must start aligned");
+
+static double elapsedNs(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now()-start).count();
+}
+
+TrajectoryRecorder::TrajectoryRecorder() :
+	file(nullptr), stopping(false), writeFailed(false),
+	framesWritten(0), framesFailed(0), bytesWritten(0), rawBytesWritten(0) {
+	std::memset(&header, 0, sizeof(header));
+	std::memset(&stats, 0, sizeof(stats));
+	std::memset(&writerStats, 0, sizeof(writerStats));
+}
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+	Close();
+}
+
+bool TrajectoryRecorder::Open(const char* path, unsigned int count, const TrajectoryOptions& newOptions, std::string* error) {
+	Close();
+	if (newOptions.encoding==TrajectoryEncoding::Quantized16 &&
+		(newOptions.quantization.boundsSize.x<=0 || newOptions.quantization.boundsSize.y<=0)) {
+		if (error) *error="quantized recording needs the simulation bounds";
+		return false;
+	}
+	file=fopen(path, "wb");
+	if (!file) {
+		if (error) *error=std::string("cannot create ")+path;
+		return false;
+	}
+	options=newOptions;
+	options.interval=std::max(1u, options.interval);
+	options.numBuffers=std::max(1u, options.numBuffers);
+
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic));
+	header.version=TRAJECTORY_VERSION;
+	header.headerBytes=sizeof(TrajectoryHeader);
+	header.count=count;
+	header.stride=(count+15)/16*16;
+	header.interval=options.interval;
+	header.encoding=(uint32_t)options.encoding;
+	if (fwrite(&header, sizeof(header), 1, file)!=1) {
+		fclose(file);
+		file=nullptr;
+		if (error) *error=std::string("cannot write ")+path;
+		return false;
+	}
+
+	// Every buffer is allocated and touched up front so recording never
+	// allocates or faults on the simulation thread.
+	buffers.resize(options.numBuffers);
+	for (FrameBuffer& buffer : buffers)
+		buffer.data.assign((size_t)header.stride*4, 0.f);
+	filledBuffers.Reset(options.numBuffers);
+	freeBuffers.Reset(options.numBuffers);
+	for (unsigned int i=0; i<options.numBuffers; i++)
+		freeBuffers.TryPush(i);
+	index.clear();
+	writeFailed=false;
+	if (options.encoding==TrajectoryEncoding::Quantized16)
+		encoder.Reset(count, options.quantization);
+	std::memset(&stats, 0, sizeof(stats));
+	std::memset(&writerStats, 0, sizeof(writerStats));
+	framesWritten=0;
+	framesFailed=0;
+	bytesWritten=0;
+	rawBytesWritten=0;
+	stopping=false;
+	writer=std::thread(&TrajectoryRecorder::writerLoop, this);
+	return true;
+}
+
+bool TrajectoryRecorder::Record(const ParticleData& particles, unsigned long long step, double time) {
+	if (!file || step%options.interval!=0 || particles.Size()!=header.count)
+		return false;
+	int bufferIdx;
+	if (!freeBuffers.TryPop(bufferIdx)) {
+		if (options.policy==RecorderPolicy::Drop) {
+			stats.dropped++;
+			return false;
+		}
+		std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+		while (!freeBuffers.TryPop(bufferIdx))
+			std::this_thread::yield();
+		stats.blockedNs+=elapsedNs(start);
+	}
+
+	// Slots move when the simulation reorders, so frames are scattered into
+	// stable ID order to keep every particle at the same place in the file.
+	std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+	FrameBuffer& buffer=buffers[bufferIdx];
+	buffer.step=step;
+	buffer.time=time;
+	float* x=buffer.data.data();
+	float* y=x+header.stride;
+	float* vx=y+header.stride;
+	float* vy=vx+header.stride;
+	PARALLEL_FOR_BEGIN(header.count) {
+		int id=particles.id[i];
+		x[id]=particles.x[i];
+		y[id]=particles.y[i];
+		vx[id]=particles.vx[i];
+		vy[id]=particles.vy[i];
+	}PARALLEL_FOR_END();
+	stats.snapshotNs+=elapsedNs(start);
+
+	filledBuffers.TryPush(bufferIdx);
+	stats.recorded++;
+	stats.maxQueued=std::max(stats.maxQueued, (unsigned int)filledBuffers.Size());
+	return true;
+}
+
+// Polls with a short sleep when idle; a frame waits at most that long, which
+// is far below the time between frames at any useful interval.
+void TrajectoryRecorder::writerLoop() {
+	while (true) {
+		int bufferIdx;
+		if (!filledBuffers.TryPop(bufferIdx)) {
+			// Stopping is checked before the last look at the queue, so every
+			// frame queued before Close is still written.
+			if (!stopping.load(std::memory_order_acquire)) {
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+				continue;
+			}
+			if (!filledBuffers.TryPop(bufferIdx))
+				return;
+		}
+		if (writeFrame(buffers[bufferIdx]))
+			framesWritten.fetch_add(1, std::memory_order_relaxed);
+		else
+			framesFailed.fetch_add(1, std::memory_order_relaxed);
+		freeBuffers.TryPush(bufferIdx);
+	}
+}
+
+bool TrajectoryRecorder::writeFrame(const FrameBuffer& buffer) {
+	if (writeFailed) return false;
+	TrajectoryFrameHeader frame;
+	std::memset(&frame, 0, sizeof(frame));
+	frame.magic=TRAJECTORY_FRAME_MAGIC;
+	frame.encoding=(uint32_t)options.encoding;
+	frame.frame=index.size();
+	frame.step=buffer.step;
+	frame.time=buffer.time;
+	const void* payload=buffer.data.data();
+	frame.payloadBytes=buffer.data.size()*sizeof(float);
+	if (options.encoding==TrajectoryEncoding::Quantized16) {
+		const float* x=buffer.data.data();
+		const float* y=x+header.stride;
+		const float* vx=y+header.stride;
+		const float* vy=vx+header.stride;
+		std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+		writerStats.keyframes+=encoder.Encode(frame.frame, x, y, vx, vy, encoded);
+		writerStats.encodeNs+=elapsedNs(start);
+		writerStats.positionError=std::max(writerStats.positionError, encoder.PositionError());
+		writerStats.velocityError=std::max(writerStats.velocityError, encoder.VelocityError());
+		payload=encoded.data();
+		frame.payloadBytes=encoded.size();
+	}
+
+	static const char zeros[TRAJECTORY_ALIGNMENT]={};
+	size_t padding=(TRAJECTORY_ALIGNMENT-frame.payloadBytes%TRAJECTORY_ALIGNMENT)%TRAJECTORY_ALIGNMENT;
+	long offset=ftell(file);
+	writeFailed=offset<0 ||
+		fwrite(&frame, sizeof(frame), 1, file)!=1 ||
+		fwrite(payload, frame.payloadBytes, 1, file)!=1 ||
+		(padding>0 && fwrite(zeros, padding, 1, file)!=1);
+	if (writeFailed) return false;
+	index.push_back((TrajectoryIndexEntry){(uint64_t)offset, buffer.step, buffer.time});
+	bytesWritten.fetch_add(sizeof(frame)+frame.payloadBytes+padding, std::memory_order_relaxed);
+	rawBytesWritten.fetch_add(buffer.data.size()*sizeof(float), std::memory_order_relaxed);
+	return true;
+}
+
+bool TrajectoryRecorder::Close() {
+	if (!file) return true;
+	stopping.store(true, std::memory_order_release);
+	writer.join();
+
+	long indexOffset=ftell(file);
+	bool ok=!writeFailed && indexOffset>=0 &&
+		(index.empty() || fwrite(index.data(), sizeof(TrajectoryIndexEntry), index.size(), file)==index.size());
+	if (ok) {
+		header.numFrames=index.size();
+		header.indexOffset=indexOffset;
+		ok=fseek(file, 0, SEEK_SET)==0 && fwrite(&header, sizeof(header), 1, file)==1;
+	}
+	ok=fclose(file)==0 && ok;
+	file=nullptr;
+	stats.written=framesWritten;
+	stats.dropped+=framesFailed;
+	stats.bytes=bytesWritten;
+	stats.rawBytes=rawBytesWritten;
+	stats.keyframes=writerStats.keyframes;
+	stats.encodeNs=writerStats.encodeNs;
+	stats.positionError=writerStats.positionError;
+	stats.velocityError=writerStats.velocityError;
+	buffers.clear();
+	return ok;
+}
+
+bool TrajectoryRecorder::IsOpen() const {
+	return file!=nullptr;
+}
+
+TrajectoryRecorderStats TrajectoryRecorder::GetStats() const {
+	TrajectoryRecorderStats current=stats;
+	if (file) {
+		current.written=framesWritten.load(std::memory_order_relaxed);
+		current.dropped+=framesFailed.load(std::memory_order_relaxed);
+		current.bytes=bytesWritten.load(std::memory_order_relaxed);
+		current.rawBytes=rawBytesWritten.load(std::memory_order_relaxed);
+	}
+	return current;
+}
@@ -0,0 +1,500 @@
+// Headless benchmark: drives FluidSimulation::SimulationStep for fixed scenes
+// without opening a window, so it runs on machines with no display or GPU.
+#include "include/FluidSimulation.hpp"
+#include "include/SoftwareRenderer.hpp"
+#include "include/TrajectoryRecorder.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef struct BenchOptions {
+	std::string scene="block";
+	std::vector<int> particleCounts={20000};
+	bool particleCountsGiven=false;
+	std::vector<int> threadCounts={0};
+	int steps=200;
+	int warmupSteps=20;
+	int settleSteps=1000;
+	float deltaTime=1.f/240;
+	bool useSimd=true;
+	bool useNeighbourCache=true;
+	int reorderInterval=0;
+	SpatialSortMode sortMode=SpatialSortMode::Radix;
+	SpatialGridMode gridMode=SpatialGridMode::Hashed;
+	bool incrementalGrid=true;
+	float migrationThreshold=0.05f;
+	ParallelSchedule schedule=ParallelSchedule::WorkStealing;
+	int grainSize=64;
+	bool sortBench=false;
+	bool deterministic=false;
+	unsigned int seed=0;
+	bool adaptive=false;
+	bool pairwise=false;
+	float verletSkin=0.f;
+	float courantNumber=0.4f;
+	std::string savePath;
+	std::string loadPath;
+	std::string recordPath;
+	TrajectoryOptions record;
+	std::string renderPath;
+	// Type of the one integer conversion in a PPM renderPath pattern.
+	char renderConversion='d';
+	int renderInterval=4;
+	int renderWidth=1470;
+	ParticleColouring colouring=ParticleColouring::Solid;
+} BenchOptions;
+
+static void printUsage() {
+	printf(
+		"usage: bench [options]\n"
+		"  --scene block|dambreak|settled   scene to simulate (default block)\n"
+		"  --particles N[,N...]             particle counts (default 20000)\n"
+		"  --threads N[,N...]               thread counts, 0 = all cores (default 0)\n"
+		"  --steps N                        timed steps per run (default 200)\n"
+		"  --warmup N                       untimed steps before timing (default 20)\n"
+		"  --settle N                       steps to settle the tank in 'settled' (default 1000)\n"
+		"  --dt SECONDS                     step size (default 1/240)\n"
+		"  --schedule static|stealing       parallel_for scheduling (default stealing)\n"
+		"  --grain N                        work-stealing chunk size (default 64)\n"
+		"  --sort std|radix                 spatial lookup sort (default radix)\n"
+		"  --grid hashed|dense              spatial lookup cell table (default hashed)\n"
+		"  --no-incremental                 rebuild the grid from scratch every update\n"
+		"  --migration F                    fraction of particles changing cell past which\n"
+		"                                   an incremental update rebuilds (default 0.05)\n"
+		"  --reorder N                      reorder particles every N steps (default off)\n"
+		"  --no-simd                        force the scalar neighbour kernels\n"
+		"  --no-cache                       query the grid instead of cached neighbour lists\n"
+		"  --sort-bench                     compare std::sort and radix sort rebuilds\n"
+		"  --deterministic                  seeded run; prints a checksum of the final state\n"
+		"  --seed N                         seed for --deterministic (default 0)\n"
+		"  --pairwise                       half-stencil pairwise forces\n"
+		"  --skin S                         Verlet neighbour lists with skin S (default off)\n"
+		"  --adaptive                       CFL timestep, with --dt as the largest step\n"
+		"  --courant C                      Courant number for --adaptive (default 0.4)\n"
+		"  --save PATH                      write a checkpoint after the untimed steps\n"
+		"  --load PATH                      start from a checkpoint instead of the scene; its\n"
+		"                                   particles and settings replace the options'\n"
+		"  --record PATH                    record the timed steps to a trajectory file\n"
+		"  --record-interval N              record every Nth step (default 1)\n"
+		"  --record-buffers N               frame buffers in flight (default 8)\n"
+		"  --record-block                   wait for the writer instead of dropping frames\n"
+		"  --record-encoding raw|quantized  frame encoding (default raw)\n"
+		"  --position-tolerance F           largest quantized position error (default finest)\n"
+		"  --velocity-tolerance F           largest quantized velocity error (default finest)\n"
+		"  --keyframe-interval N            frames per quantized keyframe (default 30)\n"
+		"  --render PATH                    render the timed steps on the CPU to a .y4m video,\n"
+		"                                   or to PPM images named by a pattern like f%%04d.ppm\n"
+		"  --render-interval N              render every Nth step (default 4)\n"
+		"  --render-width N                 image width; the height follows the bounds (default 1470)\n"
+		"  --colour solid|speed|density     particle colouring of --render (default solid)\n");
+}
+
+static std::vector<int> parseList(const char* arg) {
+	std::vector<int> values;
+	for (const char* p=arg; *p; ) {
+		values.push_back(std::atoi(p));
+		const char* comma=std::strchr(p, ',');
+		if (!comma) break;
+		p=comma+1;
+	}
+	return values;
+}
+
+static bool isVideoPath(const std::string& path) {
+	return path.size()>=4 && path.compare(path.size()-4, 4, ".y4m")==0;
+}
+
+// Checks that an image path pattern holds exactly one integer conversion,
+// such as %d or %05u, and no other conversion but %%. Sets conversion to its
+// type character.
+static bool parseFramePattern(const std::string& pattern, char& conversion) {
+	int conversions=0;
+	for (size_t i=0; i<pattern.size(); i++) {
+		if (pattern[i]!='%') continue;
+		if (++i<pattern.size() && pattern[i]=='%') continue;
+		while (i<pattern.size() && std::strchr("-+ 0", pattern[i])) i++;
+		while (i<pattern.size() && pattern[i]>='0' && pattern[i]<='9') i++;
+		if (i>=pattern.size() || !std::strchr("diu", pattern[i])) return false;
+		conversion=pattern[i];
+		conversions++;
+	}
+	return conversions==1;
+}
+
+static bool parseOptions(int argc, char** argv, BenchOptions& options) {
+	for (int i=1; i<argc; i++) {
+		std::string arg=argv[i];
+		bool hasValue=i+1<argc;
+		if (arg=="--scene" && hasValue) options.scene=argv[++i];
+		else if (arg=="--particles" && hasValue) {
+			options.particleCounts=parseList(argv[++i]);
+			options.particleCountsGiven=true;
+		}
+		else if (arg=="--threads" && hasValue) options.threadCounts=parseList(argv[++i]);
+		else if (arg=="--steps" && hasValue) options.steps=std::atoi(argv[++i]);
+		else if (arg=="--warmup" && hasValue) options.warmupSteps=std::atoi(argv[++i]);
+		else if (arg=="--settle" && hasValue) options.settleSteps=std::atoi(argv[++i]);
+		else if (arg=="--dt" && hasValue) options.deltaTime=std::atof(argv[++i]);
+		else if (arg=="--grain" && hasValue) options.grainSize=std::atoi(argv[++i]);
+		else if (arg=="--reorder" && hasValue) options.reorderInterval=std::atoi(argv[++i]);
+		else if (arg=="--schedule" && hasValue) {
+			std::string value=argv[++i];
+			options.schedule=value=="static"?ParallelSchedule::Static:ParallelSchedule::WorkStealing;
+		}
+		else if (arg=="--sort" && hasValue) {
+			std::string value=argv[++i];
+			options.sortMode=value=="std"?SpatialSortMode::Std:SpatialSortMode::Radix;
+		}
+		else if (arg=="--grid" && hasValue) {
+			std::string value=argv[++i];
+			options.gridMode=value=="dense"?SpatialGridMode::Dense:SpatialGridMode::Hashed;
+		}
+		else if (arg=="--no-incremental") options.incrementalGrid=false;
+		else if (arg=="--migration" && hasValue) options.migrationThreshold=std::atof(argv[++i]);
+		else if (arg=="--no-simd") options.useSimd=false;
+		else if (arg=="--no-cache") options.useNeighbourCache=false;
+		else if (arg=="--sort-bench") options.sortBench=true;
+		else if (arg=="--deterministic") options.deterministic=true;
+		else if (arg=="--adaptive") options.adaptive=true;
+		else if (arg=="--pairwise") options.pairwise=true;
+		else if (arg=="--skin" && hasValue) options.verletSkin=std::atof(argv[++i]);
+		else if (arg=="--courant" && hasValue) options.courantNumber=std::atof(argv[++i]);
+		else if (arg=="--save" && hasValue) options.savePath=argv[++i];
+		else if (arg=="--load" && hasValue) options.loadPath=argv[++i];
+		else if (arg=="--record" && hasValue) options.recordPath=argv[++i];
+		else if (arg=="--record-interval" && hasValue) options.record.interval=std::atoi(argv[++i]);
+		else if (arg=="--record-buffers" && hasValue) options.record.numBuffers=std::atoi(argv[++i]);
+		else if (arg=="--record-block") options.record.policy=RecorderPolicy::Block;
+		else if (arg=="--record-encoding" && hasValue) {
+			std::string value=argv[++i];
+			options.record.encoding=value=="quantized"?TrajectoryEncoding::Quantized16:TrajectoryEncoding::Raw;
+		}
+		else if (arg=="--position-tolerance" && hasValue) options.record.quantization.positionTolerance=std::atof(argv[++i]);
+		else if (arg=="--velocity-tolerance" && hasValue) options.record.quantization.velocityTolerance=std::atof(argv[++i]);
+		else if (arg=="--render" && hasValue) {
+			options.renderPath=argv[++i];
+			if (!isVideoPath(options.renderPath) && !parseFramePattern(options.renderPath, options.renderConversion)) {
+				printf("--render needs a .y4m path or an image pattern with one integer conversion, such as f%%04d.ppm\n");
+				return false;
+			}
+		}
+		else if (arg=="--render-interval" && hasValue) options.renderInterval=std::max(1, std::atoi(argv[++i]));
+		else if (arg=="--render-width" && hasValue) options.renderWidth=std::max(1, std::atoi(argv[++i]));
+		else if (arg=="--colour" && hasValue) {
+			std::string value=argv[++i];
+			options.colouring=value=="speed"?ParticleColouring::Speed:
+				value=="density"?ParticleColouring::Density:ParticleColouring::Solid;
+		}
+		else if (arg=="--keyframe-interval" && hasValue) options.record.quantization.keyframeInterval=std::atoi(argv[++i]);
+		else if (arg=="--seed" && hasValue) options.seed=std::strtoul(argv[++i], nullptr, 10);
+		else {
+			printUsage();
+			return false;
+		}
+	}
+	if (options.scene!="block" && options.scene!="dambreak" && options.scene!="settled") {
+		printUsage();
+		return false;
+	}
+	return true;
+}
+
+static double elapsedNs(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now()-start).count();
+}
+
+// Same fluid parameters as the interactive frontend. The tank grows with the
+// particle count so every scene keeps the 3600-particle fill fraction.
+static void setupSimulation(FluidSimulation& sim, const BenchOptions& options, int numParticles) {
+	float scale=std::max(1.f, sqrtf(numParticles/3600.f));
+	sim.collisionDamping=0.8f;
+	sim.numParticles=numParticles;
+	sim.mouseRadius=180;
+	sim.mouseFlag=false;
+	sim.forceType=1;
+	sim.viscosityStrength=1000.f;
+	sim.gravity=10.f;
+	sim.pressureMultiplier=6000.f;
+	sim.targetDensity=0.f;
+	sim.smoothingRadius=18;
+	sim.particleSize=2.8f;
+	sim.particleSpacing=0.9f;
+	sim.boundsSize=(Vector2){1470*scale, 890*scale};
+	sim.initialLayout=options.scene=="dambreak"?InitialLayout::DamBreak:InitialLayout::Square;
+	sim.sortMode=options.sortMode;
+	sim.gridMode=options.gridMode;
+	sim.incrementalGrid=options.incrementalGrid;
+	sim.gridMigrationThreshold=options.migrationThreshold;
+	sim.useSimd=options.useSimd;
+	sim.useNeighbourCache=options.useNeighbourCache;
+	sim.reorderInterval=options.reorderInterval;
+	sim.deterministic=options.deterministic;
+	sim.seed=options.seed;
+	sim.adaptiveTimestep=options.adaptive;
+	sim.pairwiseForces=options.pairwise;
+	sim.verletSkin=options.verletSkin;
+	sim.courantNumber=options.courantNumber;
+	sim.Start();
+}
+
+// FNV-1a over the bits of every particle's position and velocity in stable ID
+// order, so runs can be compared for bitwise equality.
+static unsigned int stateChecksum(const FluidSimulation& sim, int numParticles) {
+	const ParticleData& particles=sim.GetParticles();
+	unsigned int hash=2166136261u;
+	for (int id=0; id<numParticles; id++) {
+		int slot=sim.GetParticleSlot(id);
+		float values[4]={particles.x[slot], particles.y[slot], particles.vx[slot], particles.vy[slot]};
+		unsigned char bytes[sizeof(values)];
+		std::memcpy(bytes, values, sizeof(values));
+		for (unsigned char byte : bytes)
+			hash=(hash^byte)*16777619u;
+	}
+	return hash;
+}
+
+// Per-phase ns/particle/step over the timed steps. The grid phases are
+// skipped when their pass did not run.
+static void printPhaseStats(const FluidSimulation& sim, int numParticles) {
+	for (int p=0; p<(int)SimulationPhase::Count; p++) {
+		PhaseStats stats=sim.GetPhaseStats((SimulationPhase)p);
+		if (stats.samples==0) continue;
+		printf("  %-12s min %9.1f  mean %9.1f  p99 %9.1f ns/p/step\n",
+			SimulationPhaseName((SimulationPhase)p),
+			stats.minNs/numParticles, stats.meanNs/numParticles, stats.p99Ns/numParticles);
+	}
+	SpatialQueryStats queries=sim.GetSpatialQueryStats();
+	if (queries.queries>0)
+		printf("  grid queries: %.1f visited, %.1f accepted per query (%.0f%% accepted)\n",
+			(double)queries.visited/queries.queries, (double)queries.accepted/queries.queries,
+			100.0*queries.accepted/std::max(queries.visited, 1ull));
+	SpatialUpdateStats updates=sim.GetSpatialUpdateStats();
+	if (updates.checked>0)
+		printf("  grid updates: %llu repaired, %llu rebuilt (%llu over threshold), %.2f%% of particles changed cell\n",
+			updates.repairs, updates.rebuilds, updates.fallbacks, 100.0*updates.migrated/updates.checked);
+}
+
+// Closes the recorder, timing how long the writer needs to drain what the
+// timed steps left queued.
+static void printRecorderStats(TrajectoryRecorder& recorder, double stepsNs) {
+	std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+	bool closed=recorder.Close();
+	double drainNs=elapsedNs(start);
+	TrajectoryRecorderStats stats=recorder.GetStats();
+	printf("  recorded %llu frames, dropped %llu, %.1f MB at %.0f MB/s%s\n",
+		stats.written, stats.dropped, stats.bytes/1048576.0,
+		stats.bytes/1048576.0/((stepsNs+drainNs)*1e-9), closed?"":" (write failed)");
+	printf("  snapshot %.3f ms/frame, blocked %.1f ms, queue peak %u, drain %.1f ms\n",
+		stats.recorded?stats.snapshotNs/stats.recorded/1e6:0, stats.blockedNs/1e6, stats.maxQueued, drainNs/1e6);
+	if (stats.keyframes>0)
+		printf("  quantized %.2fx, %llu keyframes, encode %.0f MB/s, error <= %g position, %g velocity\n",
+			stats.bytes?(double)stats.rawBytes/stats.bytes:0, stats.keyframes,
+			stats.encodeNs>0?stats.rawBytes/1048576.0/(stats.encodeNs*1e-9):0,
+			stats.positionError, stats.velocityError);
+}
+
+// Renders the timed steps and writes each image straight away, timing the two
+// separately.
+typedef struct OfflineRender {
+	SoftwareRenderer renderer;
+	Y4mWriter video;
+	unsigned int frames=0;
+	double drawNs=0;
+	double writeNs=0;
+	bool failed=false;
+} OfflineRender;
+
+static bool startRender(OfflineRender& render, const BenchOptions& options, const FluidSimulation& sim) {
+	int width=options.renderWidth;
+	render.renderer.Resize(width, std::max(1, (int)lroundf(width*sim.boundsSize.y/sim.boundsSize.x)));
+	const std::string& path=options.renderPath;
+	if (!isVideoPath(path))
+		return true;
+	std::string error;
+	unsigned int fps=(unsigned int)lroundf(1/(options.deltaTime*options.renderInterval));
+	if (!render.video.Open(path.c_str(), render.renderer.Width(), render.renderer.Height(), fps, &error)) {
+		printf("%s\n", error.c_str());
+		return false;
+	}
+	return true;
+}
+
+static void renderFrame(OfflineRender& render, const BenchOptions& options, const FluidSimulation& sim) {
+	std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+	render.renderer.Render(sim.GetParticles(), sim.boundsSize, sim.particleSize, 1.f, options.colouring);
+	render.drawNs+=elapsedNs(start);
+	start=std::chrono::steady_clock::now();
+	if (render.video.IsOpen()) {
+		render.failed|=!render.video.WriteFrame(render.renderer);
+	} else {
+		char path[4096];
+		// The pattern was checked for a single d, i or u conversion.
+		if (options.renderConversion=='u')
+			snprintf(path, sizeof(path), options.renderPath.c_str(), render.frames);
+		else
+			snprintf(path, sizeof(path), options.renderPath.c_str(), (int)render.frames);
+		render.failed|=!render.renderer.WritePpm(path);
+	}
+	render.writeNs+=elapsedNs(start);
+	render.frames++;
+}
+
+static void printRenderStats(OfflineRender& render, double stepsNs) {
+	render.failed|=!render.video.Close();
+	printf("  rendered %u frames of %dx%d, draw %.2f ms/frame, write %.2f ms/frame, %.1f%% of the run%s\n",
+		render.frames, render.renderer.Width(), render.renderer.Height(),
+		render.frames?render.drawNs/render.frames/1e6:0, render.frames?render.writeNs/render.frames/1e6:0,
+		100*(render.drawNs+render.writeNs)/stepsNs, render.failed?" (write failed)":"");
+}
+
+// Returns false if the scene could not be set up: a checkpoint that would not
+// load, or a recording or render that could not be opened.
+static bool runScene(const BenchOptions& options, int numParticles, int numThreads) {
+	SetNumThreads(numThreads);
+	FluidSimulation sim;
+	int untimedSteps=options.warmupSteps+(options.scene=="settled"?options.settleSteps:0);
+	if (!options.loadPath.empty()) {
+		std::string error;
+		if (!sim.LoadCheckpoint(options.loadPath.c_str(), &error)) {
+			printf("%s\n", error.c_str());
+			return false;
+		}
+		numParticles=sim.numParticles;
+		untimedSteps=options.warmupSteps;
+	} else {
+		setupSimulation(sim, options, numParticles);
+	}
+
+	for (int step=0; step<untimedSteps; step++)
+		sim.SimulationStep(options.deltaTime);
+	if (!options.savePath.empty()) {
+		std::string error;
+		if (!sim.SaveCheckpoint(options.savePath.c_str(), &error))
+			printf("%s\n", error.c_str());
+	}
+	sim.ClearPhaseStats();
+	TrajectoryRecorder recorder;
+	if (!options.recordPath.empty()) {
+		std::string error;
+		TrajectoryOptions record=options.record;
+		record.quantization.boundsOrigin=Vector2Scale(sim.boundsSize, -0.5f);
+		record.quantization.boundsSize=sim.boundsSize;
+		if (!recorder.Open(options.recordPath.c_str(), numParticles, record, &error)) {
+			printf("%s\n", error.c_str());
+			return false;
+		}
+	}
+
+	OfflineRender render;
+	bool rendering=!options.renderPath.empty();
+	if (rendering && !startRender(render, options, sim))
+		return false;
+
+	double densityImbalance=0, forceImbalance=0;
+	double simulatedTime=0;
+	unsigned long long rebuildsBefore=sim.GetVerletStats().rebuilds;
+	float minDeltaTime=options.deltaTime, maxDeltaTime=0;
+	std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+	for (int step=0; step<options.steps; step++) {
+		float deltaTime=sim.SimulationStep(options.deltaTime);
+		simulatedTime+=deltaTime;
+		minDeltaTime=std::min(minDeltaTime, deltaTime);
+		maxDeltaTime=std::max(maxDeltaTime, deltaTime);
+		densityImbalance+=sim.GetPassStats().density.imbalance;
+		forceImbalance+=sim.GetPassStats().forces.imbalance;
+		recorder.Record(sim.GetParticles(), sim.GetStepCount(), simulatedTime);
+		if (rendering && step%options.renderInterval==0)
+			renderFrame(render, options, sim);
+	}
+	double totalNs=elapsedNs(start);
+
+	printf("%-9s %9d %7u %12.1f %10.2f %9.2f %9.2f %10.1f\n",
+		options.loadPath.empty()?options.scene.c_str():"loaded", numParticles, GetNumThreads(),
+		totalNs/options.steps/numParticles,
+		totalNs/options.steps/1e6,
+		densityImbalance/options.steps, forceImbalance/options.steps,
+		sim.GetNeighbourCacheBytes()/1048576.0);
+	if (options.verletSkin>0 && options.useNeighbourCache)
+		printf("  verlet skin %.2f: %llu rebuilds in %d steps\n", options.verletSkin,
+			sim.GetVerletStats().rebuilds-rebuildsBefore, options.steps);
+	if (options.adaptive)
+		printf("  dt min %.5f mean %.5f max %.5f, %.2f simulated s per wall s\n",
+			minDeltaTime, simulatedTime/options.steps, maxDeltaTime, simulatedTime/(totalNs*1e-9));
+	if (sim.deterministic)
+		printf("  checksum %08x, kinetic energy %.6g\n", stateChecksum(sim, numParticles), sim.GetKineticEnergy());
+	if (recorder.IsOpen())
+		printRecorderStats(recorder, totalNs);
+	if (rendering)
+		printRenderStats(render, totalNs);
+#ifdef SPH_PROFILING
+	printPhaseStats(sim, numParticles);
+#endif
+	return true;
+}
+
+// Times the spatial lookup rebuild with each sort over uniformly scattered
+// points, matching the key distribution of a mixed tank.
+static void runSortBench(const BenchOptions& options) {
+	std::vector<int> counts=options.particleCounts;
+	if (!options.particleCountsGiven) counts={10000, 100000, 500000, 2000000};
+	printf("%9s %7s %12s %12s %8s\n", "particles", "threads", "std ms", "radix ms", "speedup");
+	for (int numThreads : options.threadCounts) {
+		SetNumThreads(numThreads);
+		for (int n : counts) {
+			std::mt19937 rng(1);
+			float extent=sqrtf((float)n)*6.5f;
+			std::uniform_real_distribution<float> coord(-extent, extent);
+			std::vector<float> x(n), y(n);
+			for (int i=0; i<n; i++) {
+				x[i]=coord(rng);
+				y[i]=coord(rng);
+			}
+			double ms[2];
+			SpatialSortMode modes[2]={SpatialSortMode::Std, SpatialSortMode::Radix};
+			for (int m=0; m<2; m++) {
+				SpatialLookup lookup;
+				lookup.Resize(n);
+				lookup.SetSortMode(modes[m]);
+				lookup.UpdateSpatialLookup(x.data(), y.data(), 18);
+				int reps=std::max(3, 2000000/n);
+				std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+				for (int r=0; r<reps; r++)
+					lookup.UpdateSpatialLookup(x.data(), y.data(), 18);
+				ms[m]=elapsedNs(start)/reps/1e6;
+			}
+			printf("%9d %7u %12.3f %12.3f %7.2fx\n", n, GetNumThreads(), ms[0], ms[1], ms[0]/ms[1]);
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	BenchOptions options;
+	if (!parseOptions(argc, argv, options)) return 1;
+	SetParallelSchedule(options.schedule);
+	SetParallelGrainSize(options.grainSize);
+
+	if (options.sortBench) {
+		runSortBench(options);
+		return 0;
+	}
+
+	printf("forces: %s, simd: %s, neighbour cache: %s, sort: %s, grid: %s, schedule: %s, %d steps of %.5fs\n",
+		options.pairwise && !options.deterministic?"pairwise":"per particle",
+		options.useSimd && SimdKernelsSupported()?"avx2":"scalar",
+		options.useNeighbourCache?"on":"off",
+		options.sortMode==SpatialSortMode::Radix?"radix":"std",
+		options.gridMode==SpatialGridMode::Dense?"dense":"hashed",
+		options.schedule==ParallelSchedule::Static?"static":"stealing",
+		options.steps, options.deltaTime);
+	printf("%-9s %9s %7s %12s %10s %9s %9s %10s\n",
+		"scene", "particles", "threads", "ns/p/step", "ms/step", "imb dens", "imb force", "cache MB");
+	for (int numThreads : options.threadCounts)
+		for (int numParticles : options.particleCounts)
+			if (!runScene(options, numParticles, numThreads))
+				return 1;
+	return 0;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Binary checkpoint of a simulation, in native byte order:
+//   header          CheckpointHeader, zero padded to CHECKPOINT_ALIGNMENT
+//   particles       ParticleData's block exactly as in memory: NUM_FIELDS
+//                   arrays of stride floats
+//   accelerations   count floats, the squared pressure accelerations the
+//                   adaptive timestep reads at the start of the next step
+// Every section starts on a CHECKPOINT_ALIGNMENT boundary, so a mapping of
+// the file can be adopted as the particle arrays without copying.
+
+const uint32_t CHECKPOINT_VERSION=1;
+const size_t CHECKPOINT_ALIGNMENT=4096;
+
+// Public settings of the simulation, with enums and flags widened to int32.
+typedef struct CheckpointParameters {
+	float targetDensity;
+	float pressureMultiplier;
+	int32_t equationOfState;
+	float taitExponent;
+	float gravity;
+	int32_t forceType;
+	float collisionDamping;
+	float mouseRadius;
+	float viscosityStrength;
+	float particleSize;
+	float particleSpacing;
+	float smoothingRadius;
+	float boundsWidth;
+	float boundsHeight;
+	int32_t initialLayout;
+	int32_t sortMode;
+	int32_t gridMode;
+	int32_t incrementalGrid;
+	float gridMigrationThreshold;
+	int32_t useNeighbourCache;
+	int32_t reorderInterval;
+	int32_t reorderOrder;
+	int32_t useSimd;
+	int32_t deterministic;
+	uint32_t seed;
+	int32_t adaptiveTimestep;
+	int32_t pairwiseForces;
+	float verletSkin;
+	float courantNumber;
+	float referenceTimestep;
+	float minTimestep;
+} CheckpointParameters;
+
+typedef struct CheckpointHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerBytes;        // sizeof(CheckpointHeader)
+	uint32_t byteOrder;          // 0x01020304 as written
+	uint32_t numFields;          // ParticleData::NUM_FIELDS
+	uint64_t count;
+	uint64_t stride;             // floats per field array
+	uint64_t particleOffset;     // byte offsets of the sections
+	uint64_t accelerationOffset;
+	uint64_t fileBytes;
+	char kernels[16];            // name of the kernel set
+	uint64_t stepCount;
+	uint32_t runSeed;
+	float mass;
+	float stepScale;
+	CheckpointParameters parameters;
+} CheckpointHeader;
+
+/// Writes a checkpoint. The caller fills count, stride, kernels and the
+/// state; the magic, version and section layout are filled here. The file is
+/// written beside path and renamed over it, so a failed save never leaves a
+/// truncated checkpoint behind.
+bool WriteCheckpoint(const char* path, CheckpointHeader header, const float* particleBlock,
+	const float* accelerations, std::string* error);
+
+// Copy-on-write mapping of a checkpoint file. Writes through the mapping stay
+// private to the process.
+class MappedCheckpoint {
+	private:
+		void* base;
+		size_t bytes;
+	public:
+		MappedCheckpoint();
+		~MappedCheckpoint();
+		MappedCheckpoint(const MappedCheckpoint&)=delete;
+		MappedCheckpoint& operator=(const MappedCheckpoint&)=delete;
+
+		/// Maps path and checks the header against this build's layout.
+		bool Open(const char* path, std::string* error);
+		const CheckpointHeader& Header() const;
+		float* Particles() const;
+		float* Accelerations() const;
+		/// Gives up ownership of the mapping; the returned function unmaps it.
+		std::function<void()> Release();
+};
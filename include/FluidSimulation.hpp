@@ -3,6 +3,13 @@
 #include "raymath.h"
 #include "parallel.hpp"
 #include "SpatialLookup.hpp"
+#include "NeighbourList.hpp"
+#include "ParticleData.hpp"
+#include "SimdKernels.hpp"
+#include "SmoothingKernels.hpp"
+#include "PhaseTimer.hpp"
+#include "PairwiseAccumulator.hpp"
+#include "Checkpoint.hpp"
 #include "hsvrgb.hpp"
 
 #include <algorithm>
@@ -10,34 +17,144 @@
 #include <vector>
 #include <iostream>
 #include <limits>
+#include <string>
+#include <type_traits>
 
-class FluidSimulation {
+// Load balance of each threaded pass of the most recent SimulationStep.
+typedef struct SimulationPassStats {
+	ParallelForStats predict;
+	ParallelForStats neighbours;
+	ParallelForStats density;
+	ParallelForStats forces;
+	ParallelForStats viscosity;
+	ParallelForStats integrate;
+} SimulationPassStats;
+
+// Step size of the most recent SimulationStep and, in adaptive mode, the
+// limits it was chosen from.
+typedef struct TimestepStats {
+	float deltaTime;
+	float maxSpeed;            // distance per reference step
+	float maxAcceleration;
+	float velocityLimit;       // dt keeping v*dt within the Courant distance
+	float accelerationLimit;   // dt keeping a*dt^2 within the Courant distance
+} TimestepStats;
+
+// Neighbour list reuse in Verlet mode.
+typedef struct VerletStats {
+	unsigned long long steps;
+	unsigned long long rebuilds;
+	float maxDisplacement;   // largest move since the last rebuild, last step
+	bool rebuilt;            // whether the last step rebuilt the lists
+} VerletStats;
+
+enum class EquationOfState {
+	Linear, // pressureMultiplier * (density - targetDensity)
+	Tait    // B * ((density / targetDensity)^taitExponent - 1), stiff near rest
+};
+
+enum class ParticleOrder {
+	CellKey, // the spatial lookup's sorted cell-key order
+	ZOrder   // Morton order of grid cells across the bounds
+};
+
+enum class InitialLayout {
+	Square,   // centred block
+	DamBreak, // column against the left wall
+	Random
+};
+
+// Kernels is a kernel set from SmoothingKernels.hpp. Member definitions live
+// in FluidSimulation.cpp, which instantiates the supported sets.
+template <typename Kernels>
+class BasicFluidSimulation {
 	private:
 		void initParticlesRandomly();
 		void initParticlesInSquare();
+		void initParticlesDamBreak();
 
-		void resolveCollisions(Vector2& position, Vector2& velocity);
-		std::vector<Vector2> positions;
-		std::vector<Vector2> predictedPositions;
-		std::vector<Vector2> velocities;
-		std::vector<float> densities;
+		void predictPositions(int start, int end, float deltaTime);
+		void integratePositions(int start, int end);
+		ParticleData particles;
+		ParticleData reorderBuffer;
+		std::vector<SpatialLookupEntry> reorderKeys;
+		std::vector<SpatialLookupEntry> reorderScratch;
+		std::vector<unsigned int> reorderHistograms;
+		std::vector<int> permutation;
+		std::vector<int> particleSlots;
+		// Velocity change from viscosity, applied by integratePositions.
+		std::vector<float> viscosityX;
+		std::vector<float> viscosityY;
+		// Squared pressure acceleration of the last step, for the CFL limit.
+		std::vector<float> sqrAccelerations;
+		// dt over referenceTimestep; positions advance by velocity*stepScale.
+		float stepScale;
+		TimestepStats timestepStats;
+		float chooseTimestep(float maxDeltaTime);
+		unsigned long long stepCount;
+		// Seed of the counter-based random numbers for this run.
+		unsigned int runSeed;
+		unsigned int randomBits(unsigned int a, unsigned int b) const;
+		void reorderParticles();
+		// Sizes the per-particle buffers to numParticles and clears the
+		// step state derived from earlier steps.
+		void resetWorkspace();
+		CheckpointParameters getParameters() const;
+		void setParameters(const CheckpointParameters& parameters);
 		float mass;
 		SpatialLookup spatialLookup;
+		NeighbourList neighbourList;
+		SimulationPassStats passStats;
+
+		// Predicted positions at the last neighbour rebuild, and what the
+		// lists were built for.
+		std::vector<float> verletX;
+		std::vector<float> verletY;
+		bool verletValid;
+		float verletRadius;
+		bool verletPairwise;
+		VerletStats verletStats;
+		bool neighboursNeedRebuild();
+		void updateNeighbours();
+		PhaseTimings phaseTimings;
 
-		float smoothingKernel(float distance);
-		float smoothingKernelDerivative(float distance);
-		float viscositySmoothingKernel(float distance);
+		typename Kernels::Density densityKernel;
+		typename Kernels::Gradient gradientKernel;
+		typename Kernels::Viscosity viscosityKernel;
+		void updateKernels();
 
-		float calculateDensity(Vector2 particle);
+		SimdKernelParams simdParams;
+		bool simdActive;
+		void updateSimdParams();
+
+		template <typename Callable>
+		void forEachNeighbour(int particleIdx, Callable&& callable);
+		template <typename Callable>
+		void forEachCandidateSpan(int particleIdx, Callable&& callable);
+		template <typename Callable>
+		void forEachForwardNeighbour(int particleIdx, Callable&& callable);
+		Vector2 pressureContribution(int otherParticleIdx, Vector2 direction, float distance, float otherPressure);
+		float calculateDensity(int particleIdx);
 		float densityToPressure(float density);
+		void setDensity(int particleIdx, float density);
 		Vector2 calculatePressureForce(int sampleParticleIdx);
 		Vector2 calculateViscosityForce(int particleIdx);
+		void applyPressureForce(int particleIdx, Vector2 pressureForce, float deltaTime);
+
+		PairwiseAccumulator pairAccumulator;
+		bool pairwiseActive;
+		void calculateDensitiesPairwise();
+		void calculateForcesPairwise(float deltaTime);
 
+		// Stable ID of the particle nearest the mouse.
 		int findClosestParticle();
 		Vector2 calculateMouseForce(int particleIdx, Vector2 mousePos, float strength);
 	public:
 		float targetDensity;
 		float pressureMultiplier;
+		// Tait falls back to Linear while targetDensity is 0.
+		EquationOfState equationOfState=EquationOfState::Linear;
+		float taitExponent=7.f;
 		float gravity;
 		int forceType;
 		bool mouseFlag;
@@ -49,9 +166,86 @@ class FluidSimulation {
 		float smoothingRadius;
 		unsigned int numParticles;
 		Vector2 boundsSize;
+		// Mouse position in simulation space, set by the frontend each frame.
+		Vector2 mousePosition=(Vector2){0, 0};
+		InitialLayout initialLayout=InitialLayout::Square;
+		SpatialSortMode sortMode=SpatialSortMode::Radix;
+		// Dense indexes a table of every cell of boundsSize instead of hashing.
+		SpatialGridMode gridMode=SpatialGridMode::Hashed;
+		// Repair the grid's sorted order in place when at most this fraction
+		// of the particles changed cell since the last update.
+		bool incrementalGrid=true;
+		float gridMigrationThreshold=0.05f;
+		// Cache each step's neighbours once instead of querying the grid per pass.
+		bool useNeighbourCache=true;
+		// Every reorderInterval steps, permute the particle arrays into spatial
+		// order so neighbours sit close in memory. 0 disables reordering.
+		int reorderInterval=0;
+		ParticleOrder reorderOrder=ParticleOrder::ZOrder;
+		// Use the AVX2 neighbour kernels when the CPU supports them.
+		bool useSimd=true;
+		// Seeds every random number from seed instead of a fresh seed per Start,
+		// and forces the radix sort, so the same inputs and settings give
+		// bitwise-identical trajectories for any thread count.
+		bool deterministic=false;
+		unsigned int seed=0;
+		// Choose each step's dt from a CFL condition on the fastest and most
+		// accelerated particles. Velocities are distances per referenceTimestep,
+		// so fixed steps of that size behave exactly as non-adaptive ones.
+		bool adaptiveTimestep=false;
+		// Evaluate each interacting pair once over a half-stencil and apply it
+		// to both particles. Scalar kernels only; ignored in deterministic mode.
+		bool pairwiseForces=false;
+		// With the neighbour cache on, build the lists out to smoothingRadius
+		// plus this skin and reuse them until some particle has moved half the
+		// skin since. 0 rebuilds every step.
+		float verletSkin=0.f;
+		float courantNumber=0.4f;
+		float referenceTimestep=1.f/240;
+		float minTimestep=1.f/20000;
 
 		void Start();
 		void Reset();
-		void SimulationStep(float deltaTime);
-		void Render();
+		// Writes the complete state, parameters included, to path.
+		bool SaveCheckpoint(const char* path, std::string* error=nullptr) const;
+		// Replaces the state and parameters with those saved at path. The file
+		// is mapped copy-on-write and its particle block adopted as the
+		// particle arrays, so a restore costs a page fault per page first
+		// touched rather than a read of the file. Leaves the simulation
+		// unchanged on failure.
+		bool LoadCheckpoint(const char* path, std::string* error=nullptr);
+		// Sets the positions and velocities, given in stable ID order, without
+		// stepping, so a recording can be replayed through Render. With
+		// keepPrevious the positions replaced become the ones Render
+		// interpolates from. A different count resizes the particles. Call
+		// Start before stepping again.
+		void SetParticleState(const float* x, const float* y, const float* vx, const float* vy,
+			unsigned int count, bool keepPrevious);
+		// Returns the step size used: deltaTime, or in adaptive mode the CFL
+		// step capped at deltaTime.
+		float SimulationStep(float deltaTime);
+		// Defined in FluidSimulationRender.cpp, the only simulation code that
+		// needs raylib's runtime. Draws each particle alpha of the way from its
+		// position before the last step to its current one.
+		void Render(float alpha=1.f);
+		const SimulationPassStats& GetPassStats() const;
+		const TimestepStats& GetTimestepStats() const;
+		const VerletStats& GetVerletStats() const;
+		// Rolling timings of each phase of SimulationStep. Only recorded when
+		// built with SPH_PROFILING; otherwise every phase has zero samples.
+		PhaseStats GetPhaseStats(SimulationPhase phase) const;
+		// Grid neighbour queries since the last clear; also SPH_PROFILING only.
+		SpatialQueryStats GetSpatialQueryStats() const;
+		SpatialUpdateStats GetSpatialUpdateStats() const;
+		// Clears the phase timings and the grid query and update counts.
+		void ClearPhaseStats();
+		size_t GetNeighbourCacheBytes() const;
+		float GetKineticEnergy() const;
+		// Steps taken since Start, or restored from a checkpoint.
+		unsigned long long GetStepCount() const;
+		const ParticleData& GetParticles() const;
+		// Current storage slot of the particle with the given stable ID.
+		int GetParticleSlot(int id) const;
 };
+
+typedef BasicFluidSimulation<DefaultKernels> FluidSimulation;
@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+#include "raymath.h"
+#include "parallel.hpp"
+#include "SpatialLookup.hpp"
+
+// Per-step neighbour lists in CSR form: the neighbours of particle i are
+// indices[offsets[i]..offsets[i+1]) with their distances alongside. Buffers
+// only grow, so steady-state rebuilds do not allocate. A forward-only list
+// holds each pair once, under the particle that sees it in its forward
+// half-stencil.
+class NeighbourList {
+	private:
+		std::vector<int> offsets;
+		std::vector<int> indices;
+		std::vector<float> distances;
+	public:
+		void Build(const SpatialLookup& spatialLookup, const float* pointsX, const float* pointsY, int numPoints, bool forwardOnly=false);
+		/// Recomputes every stored distance from the current positions, for
+		/// lists reused across steps.
+		void RefreshDistances(const float* pointsX, const float* pointsY, int numPoints);
+		size_t NumPairs() const;
+		size_t MemoryBytes() const;
+		const int* Indices(int particleIdx) const { return indices.data()+offsets[particleIdx]; }
+		int Count(int particleIdx) const { return offsets[particleIdx+1]-offsets[particleIdx]; }
+
+		// Calls callable(index, distance) for every neighbour of particleIdx.
+		template <typename Callable>
+		void ForEachNeighbour(int particleIdx, Callable&& callable) const {
+			for (int k=offsets[particleIdx]; k<offsets[particleIdx+1]; k++)
+				callable(indices[k], distances[k]);
+		}
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+#include "parallel.hpp"
+
+// Per-thread accumulation arrays for pairwise passes. Each pool thread adds
+// both sides of a pair into its own copy of the arrays, so equal-and-opposite
+// contributions need neither atomics nor colouring; Sum folds the copies.
+class PairwiseAccumulator {
+	private:
+		std::vector<float> values;
+		size_t stride;
+		unsigned numThreads;
+		unsigned numComponents;
+	public:
+		PairwiseAccumulator();
+		/// Sizes and zeroes one set of numComponents arrays of count values per
+		/// pool thread. Storage only grows.
+		void Reset(unsigned count, unsigned numComponents);
+		/// Component c of the calling thread's set starts at
+		/// Local()+c*Stride().
+		float* Local() { return &values[(size_t)GetParallelThreadIndex()*numComponents*stride]; }
+		size_t Stride() const { return stride; }
+		/// Component c of element i summed over every thread's set.
+		float Sum(unsigned component, unsigned i) const {
+			float sum=0;
+			for (unsigned t=0; t<numThreads; t++)
+				sum+=values[((size_t)t*numComponents+component)*stride+i];
+			return sum;
+		}
+		size_t MemoryBytes() const { return values.capacity()*sizeof(float); }
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include "raylib.h"
+
+// Structure-of-arrays particle storage. Every field is a separate float
+// array; all of them live in one block with each array starting on a 64-byte
+// boundary, so passes over a single field stream through contiguous,
+// vector-aligned memory.
+class ParticleData {
+	private:
+		float* block;
+		size_t stride;
+		unsigned int count;
+		// Frees block; set by whoever allocated it.
+		std::function<void()> release;
+
+		void bindFields();
+	public:
+		// Alignment of every field array, in bytes.
+		static const size_t FIELD_ALIGNMENT=64;
+
+		enum Field {
+			POSITION_X,
+			POSITION_Y,
+			PREDICTED_X,
+			PREDICTED_Y,
+			VELOCITY_X,
+			VELOCITY_Y,
+			PREVIOUS_X,
+			PREVIOUS_Y,
+			DENSITY,
+			PRESSURE,
+			INV_DENSITY,
+			ID,
+			NUM_FIELDS
+		};
+
+		float* x;
+		float* y;
+		float* predictedX;
+		float* predictedY;
+		float* vx;
+		float* vy;
+		// Positions at the start of the last step, for render interpolation.
+		float* previousX;
+		float* previousY;
+		float* density;
+		// Equation of state output and 1/density, filled by the density pass.
+		float* pressure;
+		float* invDensity;
+		// Stable external ID of the particle in each slot, kept through reorders.
+		int* id;
+
+		ParticleData();
+		~ParticleData();
+		ParticleData(const ParticleData&)=delete;
+		ParticleData& operator=(const ParticleData&)=delete;
+
+		/// Reallocates and zeroes every field.
+		void Resize(unsigned int count);
+		/// Takes over count particles already laid out in this class's format:
+		/// NUM_FIELDS arrays of stride floats each, the first at block.
+		/// block must be 64-byte aligned and stride a multiple of 16. release
+		/// is called instead of free once the block is dropped.
+		void Adopt(float* block, unsigned int count, size_t stride, std::function<void()> release);
+		unsigned int Size() const;
+		/// Floats between the starts of consecutive fields.
+		size_t Stride() const;
+		float* Field(int field) const;
+		void Swap(ParticleData& other);
+		/// Fills every field with slot i taken from source slot order[i].
+		void PermuteFrom(const ParticleData& source, const int* order);
+
+		Vector2 GetPosition(int i) const { return (Vector2){x[i], y[i]}; }
+		Vector2 GetPredictedPosition(int i) const { return (Vector2){predictedX[i], predictedY[i]}; }
+		Vector2 GetPreviousPosition(int i) const { return (Vector2){previousX[i], previousY[i]}; }
+		Vector2 GetVelocity(int i) const { return (Vector2){vx[i], vy[i]}; }
+		void SetPosition(int i, Vector2 position) { x[i]=position.x; y[i]=position.y; }
+		void SetVelocity(int i, Vector2 velocity) { vx[i]=velocity.x; vy[i]=velocity.y; }
+};
@@ -0,0 +1,72 @@
+#pragma once
+#include <chrono>
+#include <vector>
+
+// Per-phase timing of SimulationStep. Timers are only compiled in when
+// SPH_PROFILING is defined; otherwise SPH_PHASE_TIMER expands to nothing and
+// every phase reports zero samples.
+
+enum class SimulationPhase {
+	Predict,
+	GridHash,       // cell keys of every particle
+	GridSort,       // sorting the entries by cell key
+	GridRepair,     // incremental update: re-sorting only migrated entries
+	GridStarts,     // start index of each cell
+	Neighbours,     // neighbour cache build
+	NeighbourCheck, // Verlet displacement check and distance refresh
+	Density,
+	Forces,
+	Integrate,      // integration and boundary collisions
+	Count
+};
+
+const char* SimulationPhaseName(SimulationPhase phase);
+
+typedef struct PhaseStats {
+	double minNs;
+	double meanNs;
+	double p99Ns;
+	double lastNs;
+	unsigned samples;   // samples in the rolling window
+} PhaseStats;
+
+// Rolling window of the most recent samples of every phase.
+class PhaseTimings {
+	private:
+		static const unsigned WINDOW=256;
+		std::vector<double> samples;
+		unsigned counts[(int)SimulationPhase::Count];
+		unsigned heads[(int)SimulationPhase::Count];
+	public:
+		PhaseTimings();
+		void Record(SimulationPhase phase, double ns);
+		PhaseStats GetStats(SimulationPhase phase) const;
+		void Clear();
+};
+
+class ScopedPhaseTimer {
+	private:
+		PhaseTimings* timings;
+		SimulationPhase phase;
+		std::chrono::steady_clock::time_point start;
+	public:
+		ScopedPhaseTimer(PhaseTimings* timings, SimulationPhase phase) :
+			timings(timings), phase(phase), start(std::chrono::steady_clock::now()) {}
+		~ScopedPhaseTimer() {
+			if (timings)
+				timings->Record(phase, std::chrono::duration<double, std::nano>(
+					std::chrono::steady_clock::now()-start).count());
+		}
+		ScopedPhaseTimer(const ScopedPhaseTimer&)=delete;
+		ScopedPhaseTimer& operator=(const ScopedPhaseTimer&)=delete;
+};
+
+#define SPH_PHASE_TIMER_CONCAT2(a, b) a##b
+#define SPH_PHASE_TIMER_CONCAT(a, b) SPH_PHASE_TIMER_CONCAT2(a, b)
+#ifdef SPH_PROFILING
+// Times the rest of the enclosing scope as phase. timings may be null.
+#define SPH_PHASE_TIMER(timings, phase) \
+	ScopedPhaseTimer SPH_PHASE_TIMER_CONCAT(phaseTimer, __LINE__)(timings, phase)
+#else
+#define SPH_PHASE_TIMER(timings, phase) do {} while (0)
+#endif
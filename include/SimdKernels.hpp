@@ -0,0 +1,37 @@
+#pragma once
+#include "raylib.h"
+
+// Constants the SIMD kernels need, refreshed whenever the simulation
+// parameters may have changed.
+typedef struct SimdKernelParams {
+	float radius;
+	float densityScale;    // mass / volume of the (h-r)^2 kernel
+	float gradientScale;   // 12 / (PI h^4), slope of the (h-r)^2 kernel
+	float viscosityScale;  // 4 / (PI h^8)
+	float mass;
+} SimdKernelParams;
+
+/// True when the running CPU supports the vector kernels (AVX2 on x86-64).
+/// Always false on other architectures, where callers use their scalar path.
+bool SimdKernelsSupported();
+
+// Each kernel accumulates over one span of candidate particles,
+// indices[k*stride] for k<count, processing 8 candidates per iteration and
+// masking out those outside the smoothing radius.
+
+float SimdDensity(const SimdKernelParams& params,
+		const int* indices, int stride, int count,
+		const float* x, const float* y, Vector2 point);
+
+// Skips the particle itself and any coincident neighbour; the number of
+// coincident neighbours is added to coincident so the caller can give them
+// a direction.
+Vector2 SimdPressureForce(const SimdKernelParams& params,
+		const int* indices, int stride, int count,
+		const float* x, const float* y, const float* pressures, const float* invDensities,
+		int particleIdx, Vector2 point, float pressure, int& coincident);
+
+Vector2 SimdViscosityForce(const SimdKernelParams& params,
+		const int* indices, int stride, int count,
+		const float* x, const float* y, const float* vx, const float* vy,
+		Vector2 point, Vector2 velocity);
@@ -0,0 +1,30 @@
+#pragma once
+
+// Fixed-timestep clock for the frame loop. Frame time goes into an
+// accumulator that is spent in whole fixed steps, so the simulation always
+// sees the same dt however irregular the frames are. Catch-up is capped per
+// frame: time beyond the cap is dropped, slowing the simulation down instead
+// of letting one hitch snowball into ever longer frames.
+class SimulationClock {
+	private:
+		float fixedDeltaTime;
+		int maxStepsPerFrame;
+		float accumulator;
+		double droppedTime;
+	public:
+		SimulationClock(float fixedDeltaTime=1.f/240, int maxStepsPerFrame=8);
+		void SetFixedDeltaTime(float deltaTime);
+		float GetFixedDeltaTime() const;
+		void SetMaxStepsPerFrame(int maxSteps);
+		int GetMaxStepsPerFrame() const;
+
+		/// Adds frameTime to the accumulator and returns how many fixed steps to
+		/// run this frame.
+		int Advance(float frameTime);
+		/// Fraction of a step left in the accumulator, for interpolating the
+		/// rendered state between the last two steps.
+		float GetAlpha() const;
+		/// Total time discarded by the catch-up cap.
+		double GetDroppedTime() const;
+		void Reset();
+};
@@ -0,0 +1,92 @@
+#pragma once
+#include "raylib.h"
+
+// SPH smoothing kernels. Each caches its normalisation for the current
+// radius in SetRadius, so evaluating it per neighbour is a few multiplies
+// and the call inlines into the neighbour loops.
+
+// (h-r)^2, the density kernel.
+struct SpikyKernel {
+	float radius=0, scale=0;
+	void SetRadius(float h) {
+		radius=h;
+		scale=6/(PI*h*h*h*h);
+	}
+	float operator()(float distance) const {
+		if (distance>=radius) return 0;
+		float v=radius-distance;
+		return v*v*scale;
+	}
+};
+
+// Derivative of SpikyKernel, used for the pressure force.
+struct SpikyGradient {
+	float radius=0, scale=0;
+	void SetRadius(float h) {
+		radius=h;
+		scale=12/(PI*h*h*h*h);
+	}
+	float operator()(float distance) const {
+		if (distance>=radius) return 0;
+		return (distance-radius)*scale;
+	}
+};
+
+// (h^2-r^2)^2, the smooth viscosity kernel. Not poly6, which is cubed.
+struct ViscosityKernel {
+	float radius=0, sqrRadius=0, scale=0;
+	void SetRadius(float h) {
+		radius=h;
+		sqrRadius=h*h;
+		scale=4/(PI*sqrRadius*sqrRadius*sqrRadius*sqrRadius);
+	}
+	float operator()(float distance) const {
+		if (distance>=radius) return 0;
+		float v=sqrRadius-distance*distance;
+		return v*v*scale;
+	}
+};
+
+// (h-r)^3, a sharper density kernel that resists particle clustering.
+struct SpikyPow3Kernel {
+	float radius=0, scale=0;
+	void SetRadius(float h) {
+		radius=h;
+		scale=10/(PI*h*h*h*h*h);
+	}
+	float operator()(float distance) const {
+		if (distance>=radius) return 0;
+		float v=radius-distance;
+		return v*v*v*scale;
+	}
+};
+
+struct SpikyPow3Gradient {
+	float radius=0, scale=0;
+	void SetRadius(float h) {
+		radius=h;
+		scale=30/(PI*h*h*h*h*h);
+	}
+	float operator()(float distance) const {
+		if (distance>=radius) return 0;
+		float v=radius-distance;
+		return -v*v*scale;
+	}
+};
+
+// Kernel sets plugged into BasicFluidSimulation. A set names the density
+// kernel, the gradient of that kernel used for pressure, and the viscosity
+// kernel. The name tags checkpoints written with the set.
+struct DefaultKernels {
+	static constexpr const char* name="spiky";
+	typedef SpikyKernel Density;
+	typedef SpikyGradient Gradient;
+	typedef ViscosityKernel Viscosity;
+};
+
+struct SpikyPow3Kernels {
+	static constexpr const char* name="spikypow3";
+	typedef SpikyPow3Kernel Density;
+	typedef SpikyPow3Gradient Gradient;
+	typedef ViscosityKernel Viscosity;
+};
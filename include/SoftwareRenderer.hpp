@@ -0,0 +1,87 @@
+#pragma once
+#include "ParticleData.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+enum class ParticleColouring {
+	Solid,    // the frontend's blue
+	Speed,    // blue for still through red at the colour range
+	Density
+};
+
+// Draws particles as filled discs into an RGB framebuffer on the CPU, for
+// machines without a GPU or display. Every particle is binned to each square
+// tile its disc overlaps, usually just one, by a counting sort that copies its
+// position and colour into the tile's bin; each tile is then drawn whole by
+// one thread streaming through its own bin, so no two threads write the same
+// pixel and particles off the image are culled.
+class SoftwareRenderer {
+	private:
+		typedef struct BinnedParticle {
+			float x;
+			float y;
+			uint8_t colour[4];
+		} BinnedParticle;
+
+		int width;
+		int height;
+		int tilesX;
+		int tilesY;
+		std::vector<uint8_t> pixels;
+		std::vector<float> screenX;
+		std::vector<float> screenY;
+		std::vector<uint8_t> shades;
+		std::vector<BinnedParticle> binned;
+		std::vector<unsigned int> tileStarts;
+		// Per block of particles, its count of each tile and then its offset
+		// into that tile's bin.
+		std::vector<unsigned int> blockTiles;
+		uint8_t palette[256][3];
+
+		void project(const ParticleData& particles, float scale, float alpha,
+			ParticleColouring colouring, float colourRange);
+		void binParticles(unsigned int count, float radius, bool shaded);
+		void drawTile(int tile, float radius);
+	public:
+		static const int TILE_SIZE=64;
+
+		SoftwareRenderer();
+		/// Reallocates the framebuffer; the image is cleared by the next Render.
+		void Resize(int width, int height);
+		int Width() const;
+		int Height() const;
+		/// Clears to black and draws every particle alpha of the way from its
+		/// previous position to its current one, as FluidSimulation::Render
+		/// does. boundsSize, centred on the origin with y up, is scaled to fit
+		/// the image. colourRange is the speed or density drawn red; 0 uses
+		/// the largest in the frame.
+		void Render(const ParticleData& particles, Vector2 boundsSize, float particleSize, float alpha=1.f,
+			ParticleColouring colouring=ParticleColouring::Solid, float colourRange=0.f);
+		/// Rows of RGB triples, top to bottom.
+		const uint8_t* Pixels() const;
+		/// Writes the image as a binary PPM.
+		bool WritePpm(const char* path, std::string* error=nullptr) const;
+};
+
+// Uncompressed YUV4MPEG2 video, 4:4:4 with BT.601 studio-range samples,
+// which players and encoders such as ffmpeg read directly.
+class Y4mWriter {
+	private:
+		FILE* file;
+		int width;
+		int height;
+		std::vector<uint8_t> planes;
+	public:
+		Y4mWriter();
+		~Y4mWriter();
+		Y4mWriter(const Y4mWriter&)=delete;
+		Y4mWriter& operator=(const Y4mWriter&)=delete;
+
+		bool Open(const char* path, int width, int height, unsigned int fps, std::string* error=nullptr);
+		/// Appends the renderer's image, which must match the opened size.
+		bool WriteFrame(const SoftwareRenderer& renderer);
+		bool Close();
+		bool IsOpen() const;
+};
@@ -2,14 +2,51 @@
 #include <vector>
 #include <iostream>
 #include <algorithm>
+#include <climits>
 #include "raymath.h"
 #include "parallel.hpp"
+#include "PhaseTimer.hpp"
 
 typedef struct SpatialLookupEntry {
 	int particleIndex;
 	unsigned int cellKey;
 } SpatialLookupEntry;
 
+enum class SpatialSortMode {
+	Std,   // serial std::sort
+	Radix  // parallel LSD radix sort with per-block histograms
+};
+
+enum class SpatialGridMode {
+	Hashed, // unbounded; cells hash into one bucket per point, buckets can collide
+	Dense   // one bucket per cell of a fixed box, points outside clamp to its edge
+};
+
+/// Points examined and points within radius over the neighbour queries since
+/// the last reset. Only counted when SPH_PROFILING is defined.
+typedef struct SpatialQueryStats {
+	unsigned long long queries;
+	unsigned long long visited;
+	unsigned long long accepted;
+} SpatialQueryStats;
+
+/// How the updates since the last reset rebuilt the sorted entries. An
+/// incremental update re-keys every point, then moves only the entries whose
+/// key changed; past the migration threshold it falls back to a full sort.
+typedef struct SpatialUpdateStats {
+	unsigned long long rebuilds;   // full sorts, fallbacks included
+	unsigned long long repairs;    // incremental updates
+	unsigned long long fallbacks;  // incremental updates over the threshold
+	unsigned long long checked;    // entries checked by incremental updates
+	unsigned long long migrated;   // of those, entries whose key changed
+} SpatialUpdateStats;
+
+/// Stable parallel LSD radix sort of entries by cellKey, for keys <= maxKey.
+/// scratch and histograms are reused between calls.
+void RadixSortEntries(std::vector<SpatialLookupEntry>& entries,
+		std::vector<SpatialLookupEntry>& scratch,
+		std::vector<unsigned int>& histograms, unsigned int maxKey);
+
 typedef struct CellCoord {
 	int x;
 	int y;
@@ -17,18 +54,193 @@ typedef struct CellCoord {
 
 class SpatialLookup {
 	private:
+		struct alignas(64) QueryCounter {
+			unsigned long long queries;
+			unsigned long long visited;
+			unsigned long long accepted;
+		};
+		// Everything the key of a position depends on.
+		struct KeySpace {
+			SpatialGridMode mode;
+			float radius;
+			Vector2 origin;
+			int cols;
+			int rows;
+			unsigned int numKeys;
+		};
+
 		std::vector<SpatialLookupEntry> spatialLookup;
-		std::vector<int> startIndices;
+		std::vector<SpatialLookupEntry> sortBuffer;
+		std::vector<unsigned int> histograms;
+		SpatialSortMode sortMode;
+		SpatialGridMode gridMode;
+		// Entries of key k are spatialLookup[cellStarts[k]..cellStarts[k+1]).
+		std::vector<int> cellStarts;
+		unsigned int numKeys;
 		float radius;
-		std::vector<Vector2> points;
+		Vector2 boundsOrigin;
+		Vector2 boundsSize;
+		int gridCols;
+		int gridRows;
+		const float* pointsX;
+		const float* pointsY;
 		std::vector<CellCoord> cellOffsets;
+		PhaseTimings* timings;
+		mutable std::vector<QueryCounter> queryCounters;
+		bool incremental;
+		float migrationThreshold;
+		// pointKeys are the keys, in keySpace, of the points in the entries.
+		bool keysValid;
+		KeySpace keySpace;
+		// Key of every point at this update and at the previous one.
+		std::vector<unsigned int> pointKeys;
+		std::vector<unsigned int> previousKeys;
+		std::vector<SpatialLookupEntry> migrants;
+		std::vector<SpatialLookupEntry> migrantsBuffer;
+		SpatialUpdateStats updateStats;
 
-		CellCoord positionToCellCoord(Vector2 position);
-		unsigned int hashCell(CellCoord cell);
-		unsigned int getKeyFromHash(unsigned int hash);
+		CellCoord positionToCellCoord(Vector2 position) const;
+		unsigned int hashCell(CellCoord cell) const;
+		unsigned int getKeyFromHash(unsigned int hash) const;
+		unsigned int cellKey(CellCoord cell) const;
+		int stencilSpans(Vector2 point, int spans[9][2]) const;
+		void sortEntries();
+		bool repairEntries();
+		void recordQuery(int visited, int accepted) const;
 	public:
 		SpatialLookup();
 		void Resize(int size);
-		void UpdateSpatialLookup(std::vector<Vector2> newPoints, float newRadius);
+		void SetSortMode(SpatialSortMode mode);
+		SpatialSortMode GetSortMode() const;
+		/// Dense mode covers the box [origin, origin+size); both take effect at
+		/// the next update.
+		void SetGridMode(SpatialGridMode mode);
+		SpatialGridMode GetGridMode() const;
+		void SetBounds(Vector2 origin, Vector2 size);
+		/// Incremental updates repair the previous order instead of sorting,
+		/// unless more than threshold of the entries changed key. The point
+		/// indices must keep naming the same points between updates; call
+		/// Invalidate after permuting them.
+		void SetIncremental(bool enabled, float threshold);
+		void Invalidate();
+		/// Buckets in the cell table: the point count when hashed, the cell
+		/// count when dense.
+		unsigned int GetNumKeys() const;
+		/// Updates record their hash, sort or repair, and start index phases
+		/// here when SPH_PROFILING is defined. Null disables recording.
+		void SetPhaseTimings(PhaseTimings* phaseTimings);
+		SpatialQueryStats GetQueryStats() const;
+		void ResetQueryStats();
+		SpatialUpdateStats GetUpdateStats() const;
+		void ResetUpdateStats();
+		/// Entries sorted by cell key as of the last update.
+		const std::vector<SpatialLookupEntry>& GetEntries() const;
+		// The point arrays are referenced, not copied, and must stay valid until
+		// the next update.
+		void UpdateSpatialLookup(const float* newPointsX, const float* newPointsY, float newRadius);
 		std::vector<int> GetPointsWithinRadius(Vector2 point);
+
+		// Calls callable(index, offset, sqrDist) for every point within radius of
+		// point, where offset is the indexed point minus point. Nothing is
+		// allocated.
+		template <typename Callable>
+		void ForEachNeighbour(Vector2 point, Callable&& callable) const;
+
+		// Calls callable(indices, stride, count) once per run of candidate
+		// points around point, where indices[k*stride] for k<count are the
+		// candidates: one run per occupied bucket when hashed, one per row of
+		// three cells when dense. Candidates are not radius-tested; this feeds
+		// the SIMD kernels.
+		template <typename Callable>
+		void ForEachCandidateSpan(Vector2 point, Callable&& callable) const;
+
+		// Calls callable(index, offset, sqrDist) for the neighbours of the
+		// indexed point in the forward half of its stencil: the later particles
+		// of its own cell and everything in the cells at (+1,-1), (+1,0), (+1,1)
+		// and (0,+1). Hashed candidates are checked against the exact cell,
+		// since a bucket can also hold colliding cells, so every pair within
+		// radius is visited from exactly one side.
+		template <typename Callable>
+		void ForEachForwardNeighbour(int pointIdx, Callable&& callable) const;
 };
+
+static_assert(sizeof(SpatialLookupEntry)==2*sizeof(int), "candidate spans stride over particleIndex");
+
+inline void SpatialLookup::recordQuery(int visited, int accepted) const {
+#ifdef SPH_PROFILING
+	unsigned thread=GetParallelThreadIndex();
+	if (thread>=queryCounters.size()) return;
+	QueryCounter& counter=queryCounters[thread];
+	counter.queries++;
+	counter.visited+=visited;
+	counter.accepted+=accepted;
+#else
+	(void)visited;
+	(void)accepted;
+#endif
+}
+
+template <typename Callable>
+void SpatialLookup::ForEachNeighbour(Vector2 point, Callable&& callable) const {
+	float sqrRadius=radius*radius;
+	int spans[9][2];
+	int numSpans=stencilSpans(point, spans);
+	int visited=0, accepted=0;
+
+	for (int s=0; s<numSpans; s++) {
+		visited+=spans[s][1]-spans[s][0];
+		for (int i=spans[s][0]; i<spans[s][1]; i++) {
+			int particleIdx=spatialLookup[i].particleIndex;
+			Vector2 pointOffset=(Vector2){pointsX[particleIdx]-point.x, pointsY[particleIdx]-point.y};
+			float sqrDist=pointOffset.x*pointOffset.x+pointOffset.y*pointOffset.y;
+			if (sqrDist<sqrRadius) {
+				accepted++;
+				callable(particleIdx, pointOffset, sqrDist);
+			}
+		}
+	}
+	recordQuery(visited, accepted);
+}
+
+template <typename Callable>
+void SpatialLookup::ForEachCandidateSpan(Vector2 point, Callable&& callable) const {
+	int spans[9][2];
+	int numSpans=stencilSpans(point, spans);
+	for (int s=0; s<numSpans; s++)
+		callable(&spatialLookup[spans[s][0]].particleIndex, 2, spans[s][1]-spans[s][0]);
+}
+
+template <typename Callable>
+void SpatialLookup::ForEachForwardNeighbour(int pointIdx, Callable&& callable) const {
+	static const CellCoord forwardOffsets[5]={{0,0}, {1,-1}, {1,0}, {1,1}, {0,1}};
+	float sqrRadius=radius*radius;
+	Vector2 point=(Vector2){pointsX[pointIdx], pointsY[pointIdx]};
+	CellCoord coord=positionToCellCoord(point);
+	int visited=0, accepted=0;
+
+	for (const CellCoord& offset : forwardOffsets) {
+		CellCoord target=(CellCoord){coord.x+offset.x, coord.y+offset.y};
+		if (gridMode==SpatialGridMode::Dense &&
+			(target.x<0 || target.x>=gridCols || target.y<0 || target.y>=gridRows))
+			continue;
+		bool ownCell=offset.x==0 && offset.y==0;
+		unsigned int key=cellKey(target);
+		visited+=cellStarts[key+1]-cellStarts[key];
+		for (int i=cellStarts[key]; i<cellStarts[key+1]; i++) {
+			int particleIdx=spatialLookup[i].particleIndex;
+			if (ownCell && particleIdx<=pointIdx) continue;
+			Vector2 other=(Vector2){pointsX[particleIdx], pointsY[particleIdx]};
+			if (gridMode==SpatialGridMode::Hashed) {
+				CellCoord otherCoord=positionToCellCoord(other);
+				if (otherCoord.x!=target.x || otherCoord.y!=target.y) continue;
+			}
+			Vector2 pointOffset=(Vector2){other.x-point.x, other.y-point.y};
+			float sqrDist=pointOffset.x*pointOffset.x+pointOffset.y*pointOffset.y;
+			if (sqrDist<sqrRadius) {
+				accepted++;
+				callable(particleIdx, pointOffset, sqrDist);
+			}
+		}
+	}
+	recordQuery(visited, accepted);
+}
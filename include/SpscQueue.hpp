@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. head is only written by the consumer and tail only by the
+// producer; each keeps a cached copy of the other's index so the shared
+// cache lines are only read when the queue looks full or empty.
+template <typename T>
+class SpscQueue {
+	private:
+		std::vector<T> slots;
+		size_t mask;
+		alignas(64) std::atomic<size_t> head;
+		size_t cachedTail;
+		alignas(64) std::atomic<size_t> tail;
+		size_t cachedHead;
+	public:
+		/// Holds at least capacity items; rounded up to a power of two.
+		explicit SpscQueue(size_t capacity=1) {
+			Reset(capacity);
+		}
+		SpscQueue(const SpscQueue&)=delete;
+		SpscQueue& operator=(const SpscQueue&)=delete;
+
+		/// Empties and resizes the queue. Neither thread may be using it.
+		void Reset(size_t capacity) {
+			size_t size=1;
+			while (size<capacity) size<<=1;
+			slots.assign(size, T());
+			mask=size-1;
+			head.store(0, std::memory_order_relaxed);
+			tail.store(0, std::memory_order_relaxed);
+			cachedTail=0;
+			cachedHead=0;
+		}
+
+		/// Producer only. Returns false when full.
+		bool TryPush(const T& item) {
+			size_t t=tail.load(std::memory_order_relaxed);
+			if (t-cachedHead>mask) {
+				cachedHead=head.load(std::memory_order_acquire);
+				if (t-cachedHead>mask) return false;
+			}
+			slots[t&mask]=item;
+			tail.store(t+1, std::memory_order_release);
+			return true;
+		}
+
+		/// Consumer only. Returns false when empty.
+		bool TryPop(T& item) {
+			size_t h=head.load(std::memory_order_relaxed);
+			if (h==cachedTail) {
+				cachedTail=tail.load(std::memory_order_acquire);
+				if (h==cachedTail) return false;
+			}
+			item=slots[h&mask];
+			head.store(h+1, std::memory_order_release);
+			return true;
+		}
+
+		/// Approximate from any thread.
+		size_t Size() const {
+			return tail.load(std::memory_order_acquire)-head.load(std::memory_order_acquire);
+		}
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include "raylib.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Byte-oriented LZ77 in the style of LZ4: sequences of a token, literals and
+// a back reference of at least 4 bytes within the last 64 KiB. Fast rather
+// than tight; it is meant for data already shaped to repeat, such as the
+// high bytes of small deltas.
+size_t LzCompressBound(size_t bytes);
+/// Returns the compressed size; dst must hold LzCompressBound(bytes).
+size_t LzCompress(const uint8_t* src, size_t bytes, uint8_t* dst);
+/// Largest size bytes of compressed data can decode to.
+uint64_t LzDecompressBound(uint64_t bytes);
+/// Returns false if src is malformed or does not decode to exactly dstBytes.
+bool LzDecompress(const uint8_t* src, size_t srcBytes, uint8_t* dst, size_t dstBytes);
+
+/// Splits 16-bit values into a plane of low bytes followed by a plane of
+/// high bytes, and back.
+void ShuffleBytes(const uint16_t* values, size_t count, uint8_t* dst);
+void UnshuffleBytes(const uint8_t* src, size_t count, uint16_t* values);
+
+typedef struct QuantizationSettings {
+	Vector2 boundsOrigin;     // box positions are quantized in
+	Vector2 boundsSize;
+	// Largest error allowed per decoded component, float rounding included.
+	// 0, or a bound finer than 16 bits can hold, uses the finest 16-bit step:
+	// boundsSize/65535 for positions and the keyframe's velocity range/65535
+	// for velocities.
+	float positionTolerance;
+	float velocityTolerance;
+	unsigned int keyframeInterval;
+} QuantizationSettings;
+
+// Leads every Quantized16 payload; the LZ-compressed, byte-shuffled values
+// follow. Positions decode as origin+q*step, velocities as
+// velocityOrigin+q*velocityStep, where q is stored directly in keyframes and
+// as a zigzag delta from the keyframe's q otherwise.
+typedef struct QuantizedFrameInfo {
+	uint64_t keyframe;         // frame index of the keyframe, itself for keyframes
+	float positionOrigin[2];
+	float positionStep[2];
+	float velocityOrigin;
+	float velocityStep;
+	uint32_t compressedBytes;
+	uint8_t padding[28];
+} QuantizedFrameInfo;
+
+// Encodes x, y, vx, vy frames of a fixed particle count. A new keyframe is
+// started every keyframeInterval frames, and early when a velocity leaves
+// the current keyframe's range.
+class QuantizedEncoder {
+	private:
+		unsigned int count;
+		QuantizationSettings settings;
+		std::vector<uint16_t> keyValues;
+		std::vector<uint16_t> values;
+		std::vector<uint8_t> shuffled;
+		QuantizedFrameInfo key;
+		float positionError;
+		float velocityError;
+		unsigned int framesSinceKey;
+		bool haveKey;
+
+		void startKeyframe(uint64_t frame, const float* vx, const float* vy);
+		bool quantize(const float* x, const float* y, const float* vx, const float* vy);
+	public:
+		QuantizedEncoder();
+		void Reset(unsigned int count, const QuantizationSettings& settings);
+		/// Replaces payload with the encoded frame. Returns whether it is a
+		/// keyframe.
+		bool Encode(uint64_t frame, const float* x, const float* y, const float* vx, const float* vy,
+			std::vector<uint8_t>& payload);
+		/// Largest error of the last frame encoded once decoded: half its
+		/// quantization step plus the float rounding of the decoded value.
+		float PositionError() const;
+		float VelocityError() const;
+};
+
+// Decodes Quantized16 payloads. A delta frame needs its keyframe decoded
+// first; KeyframeOf names it.
+class QuantizedDecoder {
+	private:
+		unsigned int count;
+		std::vector<uint16_t> keyValues;
+		std::vector<uint16_t> values;
+		std::vector<uint8_t> shuffled;
+		uint64_t keyframe;
+		bool haveKey;
+	public:
+		QuantizedDecoder();
+		void Reset(unsigned int count);
+		static uint64_t KeyframeOf(const uint8_t* payload);
+		/// Returns false if the payload is malformed or its keyframe was not the
+		/// last keyframe decoded.
+		bool Decode(uint64_t frame, const uint8_t* payload, size_t bytes,
+			float* x, float* y, float* vx, float* vy);
+};
@@ -0,0 +1,51 @@
+#pragma once
+#include "TrajectoryRecorder.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only mapping of a trajectory file written by TrajectoryRecorder.
+// Nothing is read up front: the index is used in place, and a frame's pages
+// are faulted in when it is decoded, so a recording of any size opens in
+// constant time. The next frame's pages are requested ahead of playback.
+class TrajectoryReader {
+	private:
+		const uint8_t* base;
+		size_t bytes;
+		TrajectoryHeader header;
+		// Points into the mapping, or at recoveredIndex for a file whose
+		// recorder never closed.
+		const TrajectoryIndexEntry* index;
+		uint64_t numFrames;
+		std::vector<TrajectoryIndexEntry> recoveredIndex;
+		QuantizedDecoder decoder;
+		// Keyframe the decoder holds, or numFrames when none.
+		uint64_t decodedKeyframe;
+
+		bool recoverIndex();
+		const TrajectoryFrameHeader* frameHeader(uint64_t frame) const;
+		bool decode(uint64_t frame, float* x, float* y, float* vx, float* vy);
+		void prefetch(uint64_t frame) const;
+	public:
+		TrajectoryReader();
+		~TrajectoryReader();
+		TrajectoryReader(const TrajectoryReader&)=delete;
+		TrajectoryReader& operator=(const TrajectoryReader&)=delete;
+
+		/// Maps path and checks its header and index. Fails for a file with
+		/// no frames, so Frame(0) is always valid once open.
+		bool Open(const char* path, std::string* error);
+		void Close();
+		bool IsOpen() const;
+		unsigned int Count() const;
+		unsigned int Interval() const;
+		uint64_t NumFrames() const;
+		const TrajectoryIndexEntry& Frame(uint64_t frame) const;
+		/// Last frame recorded at or before time; the first frame if time
+		/// precedes it.
+		uint64_t FindFrame(double time) const;
+		/// Fills x, y, vx and vy with Count() values each, in stable ID order.
+		/// Seeking to a delta frame decodes its keyframe first. Returns false
+		/// if the frame is out of range or malformed.
+		bool ReadFrame(uint64_t frame, float* x, float* y, float* vx, float* vy);
+};
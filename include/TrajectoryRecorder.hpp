@@ -0,0 +1,143 @@
+#pragma once
+#include "ParticleData.hpp"
+#include "SpscQueue.hpp"
+#include "TrajectoryCodec.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Trajectory file, in native byte order:
+//   TrajectoryHeader
+//   frames          each a TrajectoryFrameHeader and its payload, starting on
+//                   a TRAJECTORY_ALIGNMENT boundary
+//   index           numFrames TrajectoryIndexEntry, written on close
+// Raw payloads hold the x, y, vx and vy arrays in stable ID order, each
+// padded to stride floats; Quantized16 payloads are described in
+// TrajectoryCodec.hpp. A file whose recorder never closed has no index
+// (indexOffset 0) but can still be read by walking the frame headers.
+
+const char TRAJECTORY_MAGIC[8]={'S', 'P', 'H', 'T', 'R', 'A', 'J', '\0'};
+const uint32_t TRAJECTORY_VERSION=1;
+const size_t TRAJECTORY_ALIGNMENT=64;
+const uint32_t TRAJECTORY_FRAME_MAGIC=0x454d5246; // "FRME"
+
+enum class TrajectoryEncoding : uint32_t {
+	Raw,         // float32 arrays
+	Quantized16  // 16-bit fixed point, delta to a keyframe, shuffled and LZ compressed
+};
+
+typedef struct TrajectoryHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerBytes;
+	uint32_t count;            // particles per frame
+	uint32_t stride;           // floats per array in raw payloads
+	uint32_t interval;         // steps between recorded frames
+	uint32_t encoding;         // TrajectoryEncoding of every frame
+	uint64_t numFrames;
+	uint64_t indexOffset;
+	uint8_t padding[16];
+} TrajectoryHeader;
+
+typedef struct TrajectoryFrameHeader {
+	uint32_t magic;
+	uint32_t encoding;         // TrajectoryEncoding
+	uint64_t frame;
+	uint64_t step;
+	double time;
+	uint64_t payloadBytes;
+	uint8_t padding[24];
+} TrajectoryFrameHeader;
+
+typedef struct TrajectoryIndexEntry {
+	uint64_t offset;           // of the frame header
+	uint64_t step;
+	double time;
+} TrajectoryIndexEntry;
+
+enum class RecorderPolicy {
+	Drop,  // skip the frame and count it when every buffer is still queued
+	Block  // wait for the writer to free a buffer
+};
+
+typedef struct TrajectoryOptions {
+	unsigned int interval=1;
+	unsigned int numBuffers=8;
+	RecorderPolicy policy=RecorderPolicy::Drop;
+	TrajectoryEncoding encoding=TrajectoryEncoding::Raw;
+	// Quantized16 only; boundsSize must be set.
+	QuantizationSettings quantization=(QuantizationSettings){
+		(Vector2){0, 0}, (Vector2){0, 0}, 0.f, 0.f, 30
+	};
+} TrajectoryOptions;
+
+typedef struct TrajectoryRecorderStats {
+	unsigned long long recorded;   // frames handed to the writer
+	unsigned long long written;
+	unsigned long long dropped;    // frames lost to a full queue or a write error
+	unsigned long long bytes;
+	unsigned long long rawBytes;   // payload bytes before encoding
+	unsigned long long keyframes;
+	double snapshotNs;             // simulation thread time spent copying
+	double blockedNs;              // simulation thread time spent waiting
+	double encodeNs;               // writer thread time spent encoding
+	float positionError;           // largest quantization error bounds used
+	float velocityError;
+	unsigned int maxQueued;        // deepest the queue got
+} TrajectoryRecorderStats;
+
+// Records every interval'th step of a simulation to a trajectory file. The
+// simulation thread only copies the state into one of a fixed pool of
+// buffers; a writer thread takes filled buffers from a lock-free queue,
+// writes them out, and hands them back through a second queue.
+class TrajectoryRecorder {
+	private:
+		struct FrameBuffer {
+			unsigned long long step;
+			double time;
+			std::vector<float> data;
+		};
+
+		FILE* file;
+		TrajectoryHeader header;
+		TrajectoryOptions options;
+		std::vector<FrameBuffer> buffers;
+		SpscQueue<int> filledBuffers;
+		SpscQueue<int> freeBuffers;
+		std::thread writer;
+		std::atomic<bool> stopping;
+		std::vector<TrajectoryIndexEntry> index;
+		bool writeFailed;
+		// Writer thread state.
+		QuantizedEncoder encoder;
+		std::vector<uint8_t> encoded;
+		TrajectoryRecorderStats writerStats;
+
+		TrajectoryRecorderStats stats;
+		std::atomic<unsigned long long> framesWritten;
+		std::atomic<unsigned long long> framesFailed;
+		std::atomic<unsigned long long> bytesWritten;
+		std::atomic<unsigned long long> rawBytesWritten;
+
+		void writerLoop();
+		bool writeFrame(const FrameBuffer& buffer);
+	public:
+		TrajectoryRecorder();
+		~TrajectoryRecorder();
+		TrajectoryRecorder(const TrajectoryRecorder&)=delete;
+		TrajectoryRecorder& operator=(const TrajectoryRecorder&)=delete;
+
+		/// Creates path and starts the writer thread.
+		bool Open(const char* path, unsigned int count, const TrajectoryOptions& options, std::string* error);
+		/// Snapshots particles if step is a multiple of the interval. Returns
+		/// whether a frame was queued.
+		bool Record(const ParticleData& particles, unsigned long long step, double time);
+		/// Writes out the queued frames and the index. Returns false if any
+		/// write failed.
+		bool Close();
+		bool IsOpen() const;
+		TrajectoryRecorderStats GetStats() const;
+};
@@ -1,10 +1,94 @@
 #pragma once
-// https://stackoverflow.com/a/49188371
+// Interface based on https://stackoverflow.com/a/49188371, backed by a
+// persistent pool so the worker threads are only created once.
 #include <algorithm>
-#include <thread>
+#include <atomic>
+#include <condition_variable>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
+enum class ParallelSchedule {
+	Static,       // one equal slab per thread
+	WorkStealing  // grain-sized chunks, idle threads steal from the others
+};
+
+typedef struct ParallelForStats {
+	float imbalance;    // slowest thread's busy time over the mean, 1 is perfect
+	unsigned chunks;
+	unsigned steals;
+} ParallelForStats;
+
+class ThreadPool {
+	private:
+		// Chunk indices [front, back) packed into one word so the owner can pop
+		// the front and thieves can take the back with a single CAS each.
+		struct alignas(64) ChunkQueue {
+			std::atomic<unsigned long long> range;
+			std::atomic<unsigned> steals;
+			long long busyNs;
+		};
+
+		std::vector<std::thread> workers;
+		std::unique_ptr<ChunkQueue[]> queues;
+		std::mutex mutex;
+		std::mutex runMutex;
+		std::condition_variable wake;
+		std::condition_variable done;
+		unsigned long long generation;
+		unsigned pending;
+		bool stopping;
+		unsigned numThreads;
+		ParallelSchedule schedule;
+		unsigned grainSize;
+		ParallelForStats lastStats;
+
+		const std::function<void (int start, int end)>* job;
+		unsigned jobElements;
+		unsigned jobChunks;
+		unsigned jobGrainSize;
+
+		void startWorkers();
+		void stopWorkers();
+		void workerLoop(unsigned threadIdx, unsigned long long seen);
+		void runThread(unsigned threadIdx);
+		void runSlab(unsigned slab);
+		void runChunk(unsigned chunk);
+		bool popChunk(unsigned queue, unsigned& chunk);
+		bool stealChunk(unsigned queue, unsigned& chunk);
+	public:
+		ThreadPool(unsigned numThreads=0);
+		~ThreadPool();
+		ThreadPool(const ThreadPool&)=delete;
+		ThreadPool& operator=(const ThreadPool&)=delete;
+
+		/// 0 picks hardware_concurrency(), or SPH_NUM_THREADS when set.
+		void SetNumThreads(unsigned numThreads);
+		unsigned GetNumThreads() const;
+		void SetSchedule(ParallelSchedule schedule);
+		ParallelSchedule GetSchedule() const;
+		/// Elements per chunk in work-stealing mode.
+		void SetGrainSize(unsigned grainSize);
+		unsigned GetGrainSize() const;
+		/// Stats of the most recent threaded Run().
+		ParallelForStats GetLastStats() const;
+		/// grainSize 0 uses the pool's grain size.
+		void Run(unsigned nb_elements, const std::function<void (int start, int end)>& functor, unsigned grainSize=0);
+};
+
+/// Process-wide pool used by parallel_for, created on first use.
+ThreadPool& GetThreadPool();
+void SetNumThreads(unsigned numThreads);
+unsigned GetNumThreads();
+void SetParallelSchedule(ParallelSchedule schedule);
+void SetParallelGrainSize(unsigned grainSize);
+ParallelForStats GetLastParallelForStats();
+/// Index in [0, GetNumThreads()) of the pool thread running the caller; the
+/// thread that called parallel_for is 0. Lets passes keep per-thread buffers.
+unsigned GetParallelThreadIndex();
+
 /// @param[in] nb_elements : size of your for loop
 /// @param[in] functor(start, end) :
 /// your function processing a sub chunk of the for loop.
@@ -16,46 +100,41 @@
 /// @endcode
 /// @param use_threads : enable / disable threads.
 ///
-///
-static
+/// Calls made from inside a parallel_for body run serially on the calling
+/// thread.
 void parallel_for(unsigned nb_elements,
-                  std::function<void (int start, int end)> functor,
-                  bool use_threads = true)
-{
-    // -------
-    unsigned nb_threads_hint = std::thread::hardware_concurrency();
-    unsigned nb_threads = nb_threads_hint == 0 ? 8 : (nb_threads_hint);
-
-    unsigned batch_size = nb_elements / nb_threads;
-    unsigned batch_remainder = nb_elements % nb_threads;
-
-    std::vector< std::thread > my_threads(nb_threads);
-
-    if( use_threads )
-    {
-        // Multithread execution
-        for(unsigned i = 0; i < nb_threads; ++i)
-        {
-            int start = i * batch_size;
-            my_threads[i] = std::thread(functor, start, start+batch_size);
-        }
-    }
-    else
-    {
-        // Single thread execution (for easy debugging)
-        for(unsigned i = 0; i < nb_threads; ++i){
-            int start = i * batch_size;
-            functor( start, start+batch_size );
-        }
-    }
-
-    // Deform the elements left
-    int start = nb_threads * batch_size;
-    functor( start, start+batch_remainder);
-
-    // Wait for the other thread to finish their task
-    if( use_threads )
-        std::for_each(my_threads.begin(), my_threads.end(), std::mem_fn(&std::thread::join));
+                  const std::function<void (int start, int end)>& functor,
+                  bool use_threads = true);
+
+/// Runs functor(block) for every block in [0, nb_blocks), one block per
+/// chunk, for passes that need a fixed partition such as per-block histograms.
+void parallel_for_blocks(unsigned nb_blocks,
+                         const std::function<void (int block)>& functor);
+
+/// Elements per block of parallel_reduce. Fixed so the partition, and with it
+/// the floating point rounding, does not depend on the thread count.
+const unsigned PARALLEL_REDUCE_BLOCK = 4096;
+
+/// Reduces map(start, end) over fixed blocks of PARALLEL_REDUCE_BLOCK elements
+/// and combines the partial results serially in block order, so the result is
+/// bitwise identical for any number of threads.
+/// @code
+///     float sum = parallel_reduce(n, 0.f,
+///         [&](int start, int end){ float s = 0; for(int i = start; i < end; ++i) s += v[i]; return s; },
+///         [](float a, float b){ return a + b; });
+/// @endcode
+template <typename T, typename Map, typename Combine>
+T parallel_reduce(unsigned nb_elements, T identity, Map&& map, Combine&& combine) {
+	unsigned nb_blocks = (nb_elements + PARALLEL_REDUCE_BLOCK - 1) / PARALLEL_REDUCE_BLOCK;
+	std::vector<T> partials(nb_blocks, identity);
+	parallel_for_blocks(nb_blocks, [&](int block) {
+		unsigned start = block * PARALLEL_REDUCE_BLOCK;
+		partials[block] = map(start, std::min(nb_elements, start + PARALLEL_REDUCE_BLOCK));
+	});
+	T result = identity;
+	for (const T& partial : partials)
+		result = combine(result, partial);
+	return result;
 }
 
 #define PARALLEL_FOR_BEGIN(nb_elements) parallel_for(nb_elements, [&](int start, int end){ for(int i = start; i < end; ++i)
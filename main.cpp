@@ -1,13 +1,113 @@
 #include "include/FluidSimulation.hpp"
+#include "include/SimulationClock.hpp"
+#include "include/TrajectoryReader.hpp"
+#include "include/TrajectoryRecorder.hpp"
 #include "include/raylib.h"
 #include "include/rlgl.h"
+#include <algorithm>
 #include <iostream>
+#include <vector>
 
 const int SCREEN_WIDTH = 1470;
 const int SCREEN_HEIGHT = 890;
-const int NUM_SIM_STEPS_PER_FRAME = 4;
+// Four steps per frame at 60 FPS; slower frames catch up by at most
+// MAX_SIM_STEPS_PER_FRAME steps.
+const float SIM_DELTA_TIME = 1.f / 240;
+const int MAX_SIM_STEPS_PER_FRAME = 8;
+// Written with S and restored with L.
+const char* CHECKPOINT_PATH = "fluid.ckpt";
+// T starts and stops recording every fourth step, 60 frames per simulated
+// second, quantized to the finest 16-bit step.
+const char* TRAJECTORY_PATH = "fluid.traj";
+const unsigned int TRAJECTORY_INTERVAL = 4;
+// O replays fluid.traj without simulating, and O again returns to a fresh
+// simulation. SPACE pauses, UP and DOWN double and halve the speed, LEFT and
+// RIGHT step a frame, HOME and END jump to either end, and holding the left
+// mouse button scrubs across the width of the window.
+const float MIN_REPLAY_SPEED = 1.f / 64;
+const float MAX_REPLAY_SPEED = 64.f;
 bool simulationPaused = true;
 
+struct Replay {
+	TrajectoryReader reader;
+	std::vector<float> state;
+	double time = 0;
+	float speed = 1.f;
+	bool paused = false;
+	// Frames Render is interpolating between; from > to when none are shown.
+	uint64_t from = 1;
+	uint64_t to = 0;
+};
+
+void startReplay(Replay& replay) {
+	replay.state.resize((size_t)replay.reader.Count() * 4);
+	replay.time = replay.reader.Frame(0).time;
+	replay.speed = 1.f;
+	replay.paused = false;
+	replay.from = 1;
+	replay.to = 0;
+}
+
+bool showReplayFrame(Replay& replay, FluidSimulation& sim, uint64_t frame, bool keepPrevious) {
+	unsigned int count = replay.reader.Count();
+	float* x = replay.state.data();
+	float* y = x + count;
+	float* vx = y + count;
+	float* vy = vx + count;
+	if (!replay.reader.ReadFrame(frame, x, y, vx, vy))
+		return false;
+	sim.SetParticleState(x, y, vx, vy, count, keepPrevious);
+	return true;
+}
+
+// Advances the replay clock and shows the two frames around it; alpha is set
+// to how far the clock is between them.
+bool updateReplay(Replay& replay, FluidSimulation& sim, float& alpha) {
+	TrajectoryReader& reader = replay.reader;
+	uint64_t last = reader.NumFrames() - 1;
+	double startTime = reader.Frame(0).time;
+	double endTime = reader.Frame(last).time;
+	uint64_t current = reader.FindFrame(replay.time);
+	if (IsKeyPressed(KEY_SPACE))
+		replay.paused = !replay.paused;
+	if (IsKeyPressed(KEY_UP))
+		replay.speed = std::min(replay.speed * 2, MAX_REPLAY_SPEED);
+	if (IsKeyPressed(KEY_DOWN))
+		replay.speed = std::max(replay.speed / 2, MIN_REPLAY_SPEED);
+	if (IsKeyPressed(KEY_LEFT))
+		replay.time = reader.Frame(current > 0 ? current - 1 : 0).time;
+	if (IsKeyPressed(KEY_RIGHT))
+		replay.time = reader.Frame(std::min(current + 1, last)).time;
+	if (IsKeyPressed(KEY_HOME))
+		replay.time = startTime;
+	if (IsKeyPressed(KEY_END))
+		replay.time = endTime;
+	if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
+		float fraction = std::min(std::max((float)GetMouseX() / SCREEN_WIDTH, 0.f), 1.f);
+		replay.time = startTime + fraction * (endTime - startTime);
+	} else if (!replay.paused) {
+		replay.time += GetFrameTime() * replay.speed;
+	}
+	replay.time = std::min(std::max(replay.time, startTime), endTime);
+
+	uint64_t from = reader.FindFrame(replay.time);
+	uint64_t to = std::min(from + 1, last);
+	if (from != replay.from || to != replay.to) {
+		// Playing forward only needs the next frame; anything else is a seek.
+		if (from == replay.to && replay.from <= replay.to) {
+			if (!showReplayFrame(replay, sim, to, true)) return false;
+		} else {
+			if (!showReplayFrame(replay, sim, from, false)) return false;
+			if (!showReplayFrame(replay, sim, to, true)) return false;
+		}
+		replay.from = from;
+		replay.to = to;
+	}
+	double span = reader.Frame(to).time - reader.Frame(from).time;
+	alpha = span > 0 ? (float)((replay.time - reader.Frame(from).time) / span) : 1.f;
+	return true;
+}
+
 int main() {
 	// Initialization
 	SetConfigFlags(FLAG_MSAA_4X_HINT);
@@ -41,21 +141,111 @@ int main() {
 	sim.particleSpacing = 0.9f;
 	sim.boundsSize = (Vector2){SCREEN_WIDTH, SCREEN_HEIGHT};
 	sim.Start();
+	SimulationClock clock(SIM_DELTA_TIME, MAX_SIM_STEPS_PER_FRAME);
+	TrajectoryRecorder recorder;
+	double simulatedTime = 0;
+	Replay replay;
+	unsigned int liveParticles = sim.numParticles;
+	auto stopReplay = [&]() {
+		replay.reader.Close();
+		sim.numParticles = liveParticles;
+		sim.Start();
+		clock.Reset();
+		simulatedTime = 0;
+	};
 
 	while (!WindowShouldClose()) {
 		std::cout<<"FPS: "<<GetFPS()<<"\n";
-		if (IsKeyPressed(KEY_SPACE))
-			simulationPaused = !simulationPaused;
-		if (IsKeyPressed(KEY_R))
-			sim.Start();
-		if (IsKeyPressed(KEY_M))
-			sim.forceType=-sim.forceType;
-		sim.mouseFlag=0;
-		if (IsKeyDown(KEY_N))
-			sim.mouseFlag=1;
-		if (!simulationPaused||(simulationPaused&&IsKeyPressed(KEY_RIGHT))) {
-			for (int i = 0; i < NUM_SIM_STEPS_PER_FRAME; i++)
-				sim.SimulationStep(GetFrameTime() / NUM_SIM_STEPS_PER_FRAME);
+		if (IsKeyPressed(KEY_O)) {
+			if (replay.reader.IsOpen()) {
+				stopReplay();
+			} else if (recorder.IsOpen()) {
+				std::cout<<"stop recording before replaying\n";
+			} else {
+				std::string error;
+				if (replay.reader.Open(TRAJECTORY_PATH, &error))
+					startReplay(replay);
+				else
+					std::cout<<error<<"\n";
+			}
+		}
+		float renderAlpha = 1.f;
+		if (replay.reader.IsOpen()) {
+			if (!updateReplay(replay, sim, renderAlpha)) {
+				std::cout<<"cannot decode "<<TRAJECTORY_PATH<<"\n";
+				stopReplay();
+			}
+		} else {
+			if (IsKeyPressed(KEY_SPACE))
+				simulationPaused = !simulationPaused;
+			// Restarting or loading mid-recording would send the recorder
+			// frames whose time runs backwards, or a different particle count.
+			if (IsKeyPressed(KEY_R) && recorder.IsOpen()) {
+				std::cout<<"stop recording before restarting\n";
+			} else if (IsKeyPressed(KEY_R)) {
+				sim.Start();
+				clock.Reset();
+				simulatedTime = 0;
+			}
+			if (IsKeyPressed(KEY_S)) {
+				std::string error;
+				if (!sim.SaveCheckpoint(CHECKPOINT_PATH, &error))
+					std::cout<<error<<"\n";
+			}
+			if (IsKeyPressed(KEY_L) && recorder.IsOpen()) {
+				std::cout<<"stop recording before loading a checkpoint\n";
+			} else if (IsKeyPressed(KEY_L)) {
+				std::string error;
+				if (sim.LoadCheckpoint(CHECKPOINT_PATH, &error))
+					clock.Reset();
+				else
+					std::cout<<error<<"\n";
+			}
+			if (IsKeyPressed(KEY_T)) {
+				if (recorder.IsOpen()) {
+					recorder.Close();
+					TrajectoryRecorderStats stats = recorder.GetStats();
+					std::cout<<"recorded "<<stats.written<<" frames, dropped "<<stats.dropped<<"\n";
+				} else {
+					TrajectoryOptions options;
+					options.interval = TRAJECTORY_INTERVAL;
+					options.encoding = TrajectoryEncoding::Quantized16;
+					options.quantization.boundsOrigin = Vector2Scale(sim.boundsSize, -0.5f);
+					options.quantization.boundsSize = sim.boundsSize;
+					std::string error;
+					if (!recorder.Open(TRAJECTORY_PATH, sim.numParticles, options, &error))
+						std::cout<<error<<"\n";
+				}
+			}
+			if (IsKeyPressed(KEY_M))
+				sim.forceType=-sim.forceType;
+			if (IsKeyPressed(KEY_P)) {
+				// Phase timings are only collected in builds with SPH_PROFILING.
+				for (int p=0; p<(int)SimulationPhase::Count; p++) {
+					PhaseStats stats=sim.GetPhaseStats((SimulationPhase)p);
+					std::cout<<SimulationPhaseName((SimulationPhase)p)<<": mean "<<stats.meanNs/1000
+						<<"us, min "<<stats.minNs/1000<<"us, p99 "<<stats.p99Ns/1000<<"us\n";
+				}
+			}
+			sim.mouseFlag=0;
+			if (IsKeyDown(KEY_N))
+				sim.mouseFlag=1;
+			sim.mousePosition=Vector2Subtract(
+				GetMousePosition(),
+				Vector2Scale(sim.boundsSize, 0.5f)
+			);
+			sim.mousePosition.y=-sim.mousePosition.y;
+			if (!simulationPaused) {
+				int steps = clock.Advance(GetFrameTime());
+				for (int i = 0; i < steps; i++) {
+					simulatedTime += sim.SimulationStep(clock.GetFixedDeltaTime());
+					recorder.Record(sim.GetParticles(), sim.GetStepCount(), simulatedTime);
+				}
+				renderAlpha = clock.GetAlpha();
+			} else if (IsKeyPressed(KEY_RIGHT)) {
+				simulatedTime += sim.SimulationStep(clock.GetFixedDeltaTime());
+				recorder.Record(sim.GetParticles(), sim.GetStepCount(), simulatedTime);
+			}
 		}
 		rlSetCullFace(RL_CULL_FACE_FRONT);
 		BeginDrawing();
@@ -63,9 +253,16 @@ int main() {
 		BeginMode2D(camera);
 		rlPushMatrix();
 		rlScalef(1.0f, -1.0f, 1.0f);
-		sim.Render();
+		sim.Render(renderAlpha);
 		rlPopMatrix();
 		EndMode2D();
+		if (replay.reader.IsOpen()) {
+			uint64_t frames = replay.reader.NumFrames();
+			float progress = frames > 1 ? (float)replay.from / (frames - 1) : 1.f;
+			DrawRectangle(0, SCREEN_HEIGHT - 6, (int)(progress * SCREEN_WIDTH), 6, GRAY);
+			DrawText(TextFormat("replay frame %llu/%llu  x%g%s", (unsigned long long)replay.from + 1,
+				(unsigned long long)frames, replay.speed, replay.paused ? "  paused" : ""), 10, 10, 20, RAYWHITE);
+		}
 		EndDrawing();
 	}
 
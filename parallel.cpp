@@ -0,0 +1,266 @@
+#include "include/parallel.hpp"
+#include <chrono>
+#include <cstdlib>
+
+static thread_local bool insideParallelFor=false;
+static thread_local unsigned parallelThreadIndex=0;
+
+static unsigned defaultNumThreads() {
+	if (const char* env=std::getenv("SPH_NUM_THREADS")) {
+		int n=std::atoi(env);
+		if (n>0) return n;
+	}
+	unsigned hint=std::thread::hardware_concurrency();
+	return hint==0?8:hint;
+}
+
+static unsigned long long packRange(unsigned front, unsigned back) {
+	return ((unsigned long long)front<<32)|back;
+}
+
+static long long nowNs() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ThreadPool::ThreadPool(unsigned numThreads) :
+	generation(0), pending(0), stopping(false), numThreads(0),
+	schedule(ParallelSchedule::WorkStealing), grainSize(64),
+	lastStats((ParallelForStats){1.f, 0, 0}),
+	job(nullptr), jobElements(0), jobChunks(0), jobGrainSize(64) {
+	SetNumThreads(numThreads);
+}
+
+ThreadPool::~ThreadPool() {
+	stopWorkers();
+}
+
+void ThreadPool::SetNumThreads(unsigned n) {
+	std::lock_guard<std::mutex> runLock(runMutex);
+	if (n==0) n=defaultNumThreads();
+	if (n==numThreads) return;
+	stopWorkers();
+	numThreads=n;
+	queues.reset(new ChunkQueue[numThreads]);
+	startWorkers();
+}
+
+unsigned ThreadPool::GetNumThreads() const {
+	return numThreads;
+}
+
+void ThreadPool::SetSchedule(ParallelSchedule newSchedule) {
+	std::lock_guard<std::mutex> runLock(runMutex);
+	schedule=newSchedule;
+}
+
+ParallelSchedule ThreadPool::GetSchedule() const {
+	return schedule;
+}
+
+void ThreadPool::SetGrainSize(unsigned newGrainSize) {
+	std::lock_guard<std::mutex> runLock(runMutex);
+	grainSize=std::max(1u, newGrainSize);
+}
+
+unsigned ThreadPool::GetGrainSize() const {
+	return grainSize;
+}
+
+ParallelForStats ThreadPool::GetLastStats() const {
+	return lastStats;
+}
+
+void ThreadPool::startWorkers() {
+	stopping=false;
+	// The calling thread takes queue 0, so only numThreads-1 workers are parked.
+	for (unsigned t=1; t<numThreads; t++)
+		workers.emplace_back(&ThreadPool::workerLoop, this, t, generation);
+}
+
+void ThreadPool::stopWorkers() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping=true;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+}
+
+void ThreadPool::workerLoop(unsigned threadIdx, unsigned long long seen) {
+	insideParallelFor=true;
+	parallelThreadIndex=threadIdx;
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		wake.wait(lock, [&]{ return stopping || generation!=seen; });
+		if (stopping) return;
+		seen=generation;
+		lock.unlock();
+		runThread(threadIdx);
+		lock.lock();
+		if (--pending==0) done.notify_one();
+	}
+}
+
+void ThreadPool::runThread(unsigned threadIdx) {
+	long long begin=nowNs();
+	if (schedule==ParallelSchedule::Static) {
+		runSlab(threadIdx);
+	} else {
+		unsigned chunk;
+		while (popChunk(threadIdx, chunk))
+			runChunk(chunk);
+		for (unsigned k=1; k<numThreads; k++) {
+			unsigned victim=(threadIdx+k)%numThreads;
+			while (stealChunk(victim, chunk)) {
+				queues[threadIdx].steals.fetch_add(1, std::memory_order_relaxed);
+				runChunk(chunk);
+			}
+		}
+	}
+	queues[threadIdx].busyNs=nowNs()-begin;
+}
+
+void ThreadPool::runSlab(unsigned slab) {
+	unsigned batchSize=jobElements/numThreads;
+	unsigned start=slab*batchSize;
+	unsigned end=slab==numThreads-1?jobElements:start+batchSize;
+	if (start<end) (*job)(start, end);
+}
+
+void ThreadPool::runChunk(unsigned chunk) {
+	unsigned start=chunk*jobGrainSize;
+	(*job)(start, std::min(jobElements, start+jobGrainSize));
+}
+
+bool ThreadPool::popChunk(unsigned queue, unsigned& chunk) {
+	std::atomic<unsigned long long>& range=queues[queue].range;
+	unsigned long long r=range.load(std::memory_order_relaxed);
+	for (;;) {
+		unsigned front=r>>32, back=(unsigned)r;
+		if (front>=back) return false;
+		if (range.compare_exchange_weak(r, packRange(front+1, back), std::memory_order_acq_rel)) {
+			chunk=front;
+			return true;
+		}
+	}
+}
+
+bool ThreadPool::stealChunk(unsigned queue, unsigned& chunk) {
+	std::atomic<unsigned long long>& range=queues[queue].range;
+	unsigned long long r=range.load(std::memory_order_relaxed);
+	for (;;) {
+		unsigned front=r>>32, back=(unsigned)r;
+		if (front>=back) return false;
+		if (range.compare_exchange_weak(r, packRange(front, back-1), std::memory_order_acq_rel)) {
+			chunk=back-1;
+			return true;
+		}
+	}
+}
+
+void ThreadPool::Run(unsigned nb_elements, const std::function<void (int start, int end)>& functor, unsigned chunkSize) {
+	std::lock_guard<std::mutex> runLock(runMutex);
+	if (workers.empty()) {
+		// Nested calls must still see a parallel_for in progress, or they
+		// would come back here and relock runMutex.
+		insideParallelFor=true;
+		functor(0, nb_elements);
+		insideParallelFor=false;
+		lastStats=(ParallelForStats){1.f, 1, 0};
+		return;
+	}
+	jobGrainSize=chunkSize==0?grainSize:chunkSize;
+	jobChunks=(nb_elements+jobGrainSize-1)/jobGrainSize;
+	for (unsigned t=0; t<numThreads; t++) {
+		// Contiguous runs of chunks per thread keep the initial split cache friendly.
+		unsigned front=(unsigned long long)jobChunks*t/numThreads;
+		unsigned back=(unsigned long long)jobChunks*(t+1)/numThreads;
+		queues[t].range.store(packRange(front, back), std::memory_order_relaxed);
+		queues[t].steals.store(0, std::memory_order_relaxed);
+		queues[t].busyNs=0;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job=&functor;
+		jobElements=nb_elements;
+		pending=workers.size();
+		generation++;
+	}
+	wake.notify_all();
+
+	insideParallelFor=true;
+	runThread(0);
+	insideParallelFor=false;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [&]{ return pending==0; });
+	job=nullptr;
+
+	long long maxBusy=0, totalBusy=0;
+	unsigned steals=0;
+	for (unsigned t=0; t<numThreads; t++) {
+		maxBusy=std::max(maxBusy, queues[t].busyNs);
+		totalBusy+=queues[t].busyNs;
+		steals+=queues[t].steals.load(std::memory_order_relaxed);
+	}
+	lastStats.imbalance=totalBusy>0?(float)maxBusy*numThreads/totalBusy:1.f;
+	lastStats.chunks=schedule==ParallelSchedule::Static?numThreads:jobChunks;
+	lastStats.steals=steals;
+}
+
+ThreadPool& GetThreadPool() {
+	static ThreadPool pool;
+	return pool;
+}
+
+void SetNumThreads(unsigned numThreads) {
+	GetThreadPool().SetNumThreads(numThreads);
+}
+
+unsigned GetNumThreads() {
+	return GetThreadPool().GetNumThreads();
+}
+
+void SetParallelSchedule(ParallelSchedule schedule) {
+	GetThreadPool().SetSchedule(schedule);
+}
+
+void SetParallelGrainSize(unsigned grainSize) {
+	GetThreadPool().SetGrainSize(grainSize);
+}
+
+ParallelForStats GetLastParallelForStats() {
+	return GetThreadPool().GetLastStats();
+}
+
+unsigned GetParallelThreadIndex() {
+	return parallelThreadIndex;
+}
+
+void parallel_for(unsigned nb_elements,
+                  const std::function<void (int start, int end)>& functor,
+                  bool use_threads) {
+	if (nb_elements==0) return;
+	if (!use_threads || insideParallelFor) {
+		functor(0, nb_elements);
+		return;
+	}
+	GetThreadPool().Run(nb_elements, functor);
+}
+
+void parallel_for_blocks(unsigned nb_blocks,
+                         const std::function<void (int block)>& functor) {
+	std::function<void (int start, int end)> blocks=[&](int start, int end) {
+		for (int block=start; block<end; ++block)
+			functor(block);
+	};
+	if (nb_blocks==0) return;
+	if (insideParallelFor) {
+		blocks(0, nb_blocks);
+		return;
+	}
+	GetThreadPool().Run(nb_blocks, blocks, 1);
+}